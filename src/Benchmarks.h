@@ -0,0 +1,417 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include "MidiMerger.h"
+#include "Xorshift.h"
+#include "MappingCompiler.h"
+#include "MappingPatch.h"
+#include "MappingCheck.h"
+#include "DefaultMapping.h"
+#include "OutputThinner.h"
+
+// On-device benchmarks, run from the serial console ('bench ...')
+//
+// Each benchmark drives an engine with synthetic input, checks the result
+// for correctness and prints the achieved throughput. Nothing is sent on
+// the MIDI output. Engines and tables are allocated for the run and freed
+// afterwards, so the benchmarks hold no RAM while idle.
+
+// Synthetic running-status byte stream: one status byte, then data pairs
+// encoding a message counter. Optionally sprinkles real-time clock bytes
+// in the middle of messages.
+struct BenchStream
+{
+  uint8_t status;
+  bool clocks;
+  uint32_t count = 0; // Messages completed
+  uint32_t bytes = 0; // Bytes produced
+  uint32_t clockBytes = 0;
+  uint8_t phase = 0;  // 0 = status, 1 = first data byte, 2 = second data byte
+  bool statusSent = false;
+
+  BenchStream(uint8_t status, bool clocks) : status(status), clocks(clocks) {}
+
+  // Function to check that the stream ended on a message boundary
+  bool done(uint32_t messages) const { return count >= messages && phase == 0; }
+
+  // Function to produce the next byte of the stream
+  uint8_t next()
+  {
+    bytes++;
+    if (clocks && bytes % 5 == 0)
+    {
+      clockBytes++;
+      return 0xF8;
+    }
+    if (!statusSent)
+    {
+      statusSent = true;
+      return status;
+    }
+    if (phase == 0)
+    {
+      phase = 1;
+      return count & 0x7F;
+    }
+    phase = 0;
+    return (count++ >> 7) & 0x7F;
+  }
+};
+
+// Function to benchmark the DIN + USB merger
+// Two running-status streams are interleaved byte by byte in random order;
+// every message must come out whole, tagged with its source, in order.
+inline void benchMerge(uint32_t messagesPerSource)
+{
+  auto mergerHeap = std::make_unique<MidiMerger>();
+  MidiMerger &merger = *mergerHeap;
+  merger.reset();
+
+  BenchStream din(0xB0, false); // CC stream, plain running status
+  BenchStream usb(0x91, true);  // Note stream with clock bytes inside messages
+  uint32_t expected[SRC_COUNT] = {0, 0};
+  uint32_t clocks = 0, events = 0, errors = 0;
+  uint32_t fakeTime = 0, lastTime = 0;
+  uint32_t rng = 0x12345678;
+
+  uint32_t start = micros();
+  while (!din.done(messagesPerSource) || !usb.done(messagesPerSource))
+  {
+    // Pick the source for the next byte at random
+    xorshift32(rng);
+    bool pickDin = (rng & 1) ? !din.done(messagesPerSource) : usb.done(messagesPerSource);
+
+    if (pickDin)
+      merger.feed(SRC_DIN, din.next(), ++fakeTime);
+    else
+      merger.feed(SRC_USB, usb.next(), ++fakeTime);
+
+    MidiEvent ev;
+    while (merger.pop(ev, fakeTime))
+    {
+      events++;
+      if ((int32_t)(ev.timeUs - lastTime) < 0)
+        errors++; // Out of timestamp order
+      lastTime = ev.timeUs;
+
+      if (ev.msg.bytes[0] == 0xF8 && ev.source == SRC_USB)
+      {
+        clocks++;
+        continue;
+      }
+
+      uint8_t wantStatus = (ev.source == SRC_DIN) ? 0xB0 : 0x91;
+      uint32_t k = expected[ev.source]++;
+      if (ev.msg.length != 3 || ev.msg.bytes[0] != wantStatus ||
+          ev.msg.bytes[1] != (k & 0x7F) || ev.msg.bytes[2] != ((k >> 7) & 0x7F))
+        errors++;
+    }
+  }
+  uint32_t elapsed = micros() - start;
+  if (elapsed == 0)
+    elapsed = 1;
+
+  if (expected[SRC_DIN] != messagesPerSource || expected[SRC_USB] != messagesPerSource || clocks != usb.clockBytes)
+    errors++;
+
+  uint32_t bytes = din.bytes + usb.bytes;
+  uint32_t bytesPerSec = (uint64_t)bytes * 1000000 / elapsed;
+
+  Serial.println("\n=== Merge Benchmark ===");
+  Serial.printf("Messages/source: %lu\n", (unsigned long)messagesPerSource);
+  Serial.printf("Bytes in       : %lu (DIN %lu, USB %lu)\n", (unsigned long)bytes, (unsigned long)din.bytes, (unsigned long)usb.bytes);
+  Serial.printf("Events out     : %lu\n", (unsigned long)events);
+  Serial.printf("Time           : %lu us\n", (unsigned long)elapsed);
+  Serial.printf("Throughput     : %lu bytes/s, %lu events/s\n", (unsigned long)bytesPerSec,
+                (unsigned long)((uint64_t)events * 1000000 / elapsed));
+  Serial.printf("Line rate      : %lux one 31250-baud port\n", (unsigned long)(bytesPerSec / 3125));
+  Serial.printf("Errors         : %lu %s\n", (unsigned long)errors, errors ? "✗ FAIL" : "✓ PASS");
+  Serial.println("=======================\n");
+}
+
+// Function to benchmark wide fan-out: one CC driving `width` outputs
+// Each output has its own scale factor; outputs are read straight from the
+// arena span and encoded, but not sent.
+inline void benchFanout(uint32_t inputs, int width)
+{
+  auto mappingHeap = std::make_unique<RuntimeMapping>();
+  RuntimeMapping &mapping = *mappingHeap;
+  std::vector<ConditionalOutput> rules;
+  for (int i = 0; i < width; i++)
+  {
+    ConditionalOutput rule = simpleOutput(MSG_CC, (20 + i) & 0x7F, 0);
+    rule.out.scale = 0.5f + (float)i / width; // 0.5 .. 1.5
+    rules.push_back(rule);
+  }
+
+  MapSlot &slot = mapping.slots[slotIndex(MSG_CC, 1)];
+  mapping.outputs.clear();
+  assembleSlot(rules, mapping, slot);
+  MappingTable table = mapping.table();
+
+  MidiData midi = {MSG_CC, 1, 0, 0, 0, SRC_DIN};
+  uint32_t outputs = 0, errors = 0, checksum = 0;
+
+  uint32_t start = micros();
+  for (uint32_t n = 0; n < inputs; n++)
+  {
+    midi.inValue = n & 0x7F;
+    int index = 0;
+    mapMessage(table, midi, nullptr, [&](const MappedOutput &out)
+               {
+                 // Encode like the MIDI output does: status, number, value
+                 uint8_t bytes[3] = {(uint8_t)(0xB0 | (n & 0x0F)), (uint8_t)(out.number & 0x7F), (uint8_t)(out.value & 0x7F)};
+                 checksum = checksum * 31 + bytes[0] + bytes[1] + bytes[2];
+                 if (out.number != ((20 + index) & 0x7F))
+                   errors++;
+                 index++;
+                 outputs++; });
+  }
+  uint32_t elapsed = micros() - start;
+  if (elapsed == 0)
+    elapsed = 1;
+
+  if (outputs != inputs * width)
+    errors++;
+
+  uint32_t outputsPerSec = (uint64_t)outputs * 1000000 / elapsed;
+  uint32_t wireOutputsPerSec = 3125 / 3; // 3-byte messages on one 31250-baud port
+
+  Serial.println("\n=== Fan-out Benchmark ===");
+  Serial.printf("Fan-out        : 1 -> %d (arena %u bytes)\n", width, (unsigned)(mapping.outputs.size() * sizeof(CompiledOutput)));
+  Serial.printf("Inputs         : %lu\n", (unsigned long)inputs);
+  Serial.printf("Outputs        : %lu\n", (unsigned long)outputs);
+  Serial.printf("Time           : %lu us (%lu ns/output)\n", (unsigned long)elapsed,
+                (unsigned long)((uint64_t)elapsed * 1000 / (outputs ? outputs : 1)));
+  Serial.printf("Throughput     : %lu inputs/s, %lu outputs/s\n",
+                (unsigned long)((uint64_t)inputs * 1000000 / elapsed), (unsigned long)outputsPerSec);
+  Serial.printf("Wire headroom  : %lux one 31250-baud port\n", (unsigned long)(outputsPerSec / wireOutputsPerSec));
+  Serial.printf("Errors         : %lu %s (checksum %08lx)\n", (unsigned long)errors, errors ? "✗ FAIL" : "✓ PASS",
+                (unsigned long)checksum);
+  Serial.println("=========================\n");
+}
+
+
+// Function to check incremental mapping patches against full recompiles
+// Starts from the built-in mapping and applies random set/rep/del patches,
+// each one round-tripped through MessagePack like a UI patch frame. Every
+// 100 patches (and at the end) the patched tables must match a fresh
+// compile of the same document for all 3 x 128 x 128 inputs.
+inline void benchPatch(uint32_t patches)
+{
+  auto patchedHeap = std::make_unique<RuntimeMapping>();
+  RuntimeMapping &patched = *patchedHeap;
+  auto referenceHeap = std::make_unique<RuntimeMapping>();
+  RuntimeMapping &reference = *referenceHeap;
+  JsonDocument doc;
+  defaultMappingDocument(doc);
+  compileMapping(doc, patched);
+
+  uint32_t rng = 0x2468ACE1;
+  uint32_t results[5] = {0, 0, 0, 0, 0};
+  uint32_t errors = 0, checks = 0, compactions = 0;
+  uint32_t patchUs = 0, compileUs = 0, maxPatchUs = 0;
+  uint8_t frame[512];
+
+  for (uint32_t i = 1; i <= patches; i++)
+  {
+    // Build a random patch and send it through MessagePack
+    JsonDocument request;
+    randomPatch(request, rng);
+    size_t len = serializeMsgPack(request, frame, sizeof(frame));
+    JsonDocument patch;
+    if (deserializeMsgPack(patch, frame, len))
+    {
+      errors++;
+      continue;
+    }
+
+    size_t arenaBefore = patched.outputs.size();
+    PatchedRange changed;
+    uint32_t start = micros();
+    PatchResult result = applyPatch(doc, patched, patch.as<JsonVariant>(), changed);
+    uint32_t elapsed = micros() - start;
+    patchUs += elapsed;
+    maxPatchUs = max(maxPatchUs, elapsed);
+    results[result]++;
+    if (patched.outputs.size() < arenaBefore)
+      compactions++;
+
+    if (i % 100 == 0 || i == patches)
+    {
+      start = micros();
+      if (!compileMapping(doc, reference))
+        errors++;
+      compileUs += micros() - start;
+      errors += compareMappings(patched.table(), reference.table());
+      checks++;
+    }
+  }
+
+  // Patches start from the JSON form of the built-in mapping: it must match the flash tables
+  uint32_t defaultDiffs = checkDefaultMapping();
+  errors += defaultDiffs;
+
+  if (patches == 0)
+    patches = 1;
+  if (checks == 0)
+    checks = 1;
+
+  Serial.println("\n=== Patch Benchmark ===");
+  Serial.printf("Patches        : %lu (ok %lu, not found %lu, bad %lu, too large %lu)\n", (unsigned long)patches,
+                (unsigned long)results[PATCH_OK], (unsigned long)results[PATCH_NOT_FOUND],
+                (unsigned long)results[PATCH_BAD_REQUEST], (unsigned long)results[PATCH_TOO_LARGE]);
+  Serial.printf("Patch time     : %lu us avg, %lu us max\n", (unsigned long)(patchUs / patches), (unsigned long)maxPatchUs);
+  Serial.printf("Full recompile : %lu us avg\n", (unsigned long)(compileUs / checks));
+  Serial.printf("Arena          : %u outputs (%lu stale), %lu compactions\n", (unsigned)patched.outputs.size(),
+                (unsigned long)patched.staleOutputs, (unsigned long)compactions);
+  Serial.printf("Default JSON   : %lu inputs differ from the flash tables\n", (unsigned long)defaultDiffs);
+  Serial.printf("Errors         : %lu %s\n", (unsigned long)errors, errors ? "✗ FAIL" : "✓ PASS");
+  Serial.println("=======================\n");
+}
+
+// One reading of the knob-sweep trace
+struct KnobReading
+{
+  uint32_t timeMs;
+  uint8_t value;
+};
+
+// Function to build a knob-sweep trace like a hand on a noisy pot
+// Full sweeps, slow tweaks, quick flicks and rests, read every 4 ms with
+// occasional +-1 of pot noise. Only changed readings are sent, as a knob
+// controller does, so the noise shows up as flicker while the knob rests.
+inline std::vector<KnobReading> knobSweepTrace()
+{
+  // Target position and time to get there (ms)
+  static const uint16_t MOVES[][2] = {
+      {127, 600}, {127, 800}, {40, 1500}, {40, 500}, {64, 3000}, {0, 150},
+      {0, 400}, {127, 150}, {90, 2000}, {90, 1000}, {100, 4000}, {100, 600}};
+  std::vector<KnobReading> trace;
+  uint32_t rng = 0x2545F491;
+  float position = 0;
+  int last = -1;
+  uint32_t now = 0;
+
+  for (const auto &move : MOVES)
+  {
+    float from = position;
+    for (uint32_t t = 0; t < move[1]; t += 4, now += 4)
+    {
+      position = from + (move[0] - from) * (t + 4) / move[1];
+      int noise = xorshift32(rng) % 8 == 0 ? (int)(xorshift32(rng) % 3) - 1 : 0;
+      int reading = constrain((int)(position + 0.5f) + noise, 0, 127);
+      if (reading != last)
+        trace.push_back({now, (uint8_t)reading});
+      last = reading;
+    }
+  }
+  return trace;
+}
+
+// Function to measure the bytes "dedupe" saves on a knob-sweep trace
+// The knob fans out to four CCs with different scales, and a second,
+// unfiltered controller writes the same CCs now and then. Each setting runs
+// on a simulated millisecond clock and must leave every CC at the value
+// written last once the held-back values are flushed.
+inline void benchThin()
+{
+  struct Setting
+  {
+    const char *name;
+    uint8_t deadband;
+    uint8_t minGapMs;
+  };
+  static const Setting SETTINGS[] = {
+      {"off", THIN_OFF, 0}, {"dedupe", 0, 0}, {"deadband 1", 1, 0}, {"deadband 2", 2, 0},
+      {"max_rate 50", 0, 20}, {"band 1 + 50 Hz", 1, 20}};
+  static const float SCALES[] = {1.0f, 1.0f, 0.5f, 0.25f};
+  const int WIDTH = 4;
+  const uint8_t FIRST_CC = 20;
+  const uint32_t SETTLE_MS = 500; // Clock runs on after the trace to flush the last values
+  const uint32_t OTHER_MS = 700;  // Period of the unfiltered writes
+
+  std::vector<KnobReading> trace = knobSweepTrace();
+  auto mappingHeap = std::make_unique<RuntimeMapping>();
+  RuntimeMapping &mapping = *mappingHeap;
+  auto thinnerHeap = std::make_unique<OutputThinner>();
+  OutputThinner &thinner = *thinnerHeap;
+  uint32_t baselineBytes = 0, errors = 0;
+
+  Serial.println("\n=== Dedupe Benchmark ===");
+  Serial.printf("Trace          : %u readings over %lu ms, 1 -> %d CCs, other writes every %lu ms\n",
+                (unsigned)trace.size(), (unsigned long)(trace.empty() ? 0 : trace.back().timeMs), WIDTH,
+                (unsigned long)OTHER_MS);
+
+  for (const Setting &setting : SETTINGS)
+  {
+    std::vector<ConditionalOutput> rules;
+    for (int i = 0; i < WIDTH; i++)
+    {
+      ConditionalOutput rule = simpleOutput(MSG_CC, FIRST_CC + i, 0);
+      rule.out.scale = SCALES[i];
+      rule.out.deadband = setting.deadband;
+      rule.out.minGapMs = setting.minGapMs;
+      rules.push_back(rule);
+    }
+    MapSlot &slot = mapping.slots[slotIndex(MSG_CC, 1)];
+    mapping.outputs.clear();
+    assembleSlot(rules, mapping, slot);
+    MappingTable table = mapping.table();
+
+    thinner.reset();
+    thinner.resetStats();
+    uint8_t mapped[WIDTH], wire[WIDTH];
+    memset(mapped, THIN_NONE, sizeof(mapped));
+    memset(wire, THIN_NONE, sizeof(wire));
+    uint32_t bytes = 0;
+    uint32_t now = 0;
+    auto send = [&](uint8_t channel, uint8_t number, uint8_t value)
+    {
+      // Like sendMidiBytes(): every CC on the wire updates the cache
+      thinner.noteSent(channel, number, value, now);
+      wire[number - FIRST_CC] = value;
+      bytes += 3;
+    };
+
+    size_t next = 0;
+    uint32_t endMs = (trace.empty() ? 0 : trace.back().timeMs) + SETTLE_MS;
+    for (now = 0; now <= endMs; now++)
+    {
+      if (now % OTHER_MS == OTHER_MS - 1)
+      {
+        // Pass-through from another input to the same controllers
+        uint8_t number = FIRST_CC + (now / OTHER_MS) % WIDTH;
+        uint8_t value = (now / OTHER_MS * 37) & 0x7F;
+        mapped[number - FIRST_CC] = value;
+        send(0, number, value);
+      }
+      for (; next < trace.size() && trace[next].timeMs == now; next++)
+      {
+        MidiData midi = {MSG_CC, 1, trace[next].value, 0, 0, SRC_DIN};
+        mapMessage(table, midi, nullptr, [&](const MappedOutput &out)
+                   {
+                     mapped[out.number - FIRST_CC] = out.value;
+                     if (out.deadband == THIN_OFF || thinner.admit(0, out.number, out.value, out.deadband, out.minGapMs, now))
+                       send(0, out.number, out.value); });
+      }
+      thinner.flush(now, send);
+    }
+
+    for (int i = 0; i < WIDTH; i++)
+    {
+      if (wire[i] != mapped[i])
+        errors++;
+    }
+    if (setting.deadband == THIN_OFF)
+      baselineBytes = bytes;
+    uint32_t saved = baselineBytes > bytes ? baselineBytes - bytes : 0;
+    Serial.printf("%-15s: %6lu bytes, %3lu%% saved (%lu flushed)\n", setting.name, (unsigned long)bytes,
+                  (unsigned long)(baselineBytes ? (uint64_t)saved * 100 / baselineBytes : 0),
+                  (unsigned long)thinner.flushes());
+  }
+
+  Serial.printf("Errors         : %lu %s\n", (unsigned long)errors, errors ? "✗ FAIL" : "✓ PASS");
+  Serial.println("========================\n");
+}
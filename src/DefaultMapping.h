@@ -0,0 +1,112 @@
+#pragma once
+
+#include "MappingTable.h"
+#include "MappingCompiler.h"
+
+// Built-in fallback mapping
+//
+// Compiled into flash tables at build time, so the mapper works from the
+// first loop() iteration without parsing JSON or using RAM. DEFAULT_RULES is
+// the only copy: defaultMappingDocument() writes it out as JSON for 'showmap'
+// and for the first mapping patch to start from. checkDefaultMapping()
+// proves that document compiles back to the flash tables.
+
+// Note outputs triggered by CC/PC inputs have no note off of their own
+constexpr uint16_t DEFAULT_NOTE_GATE = 250;
+
+constexpr MapRule DEFAULT_RULES[] = {
+    // cc_map
+    mapRule(MSG_CC, 12, MSG_CC, 16),
+    mapRule(MSG_CC, 23, MSG_NOTE, 45, 1.0f, DEFAULT_NOTE_GATE),
+    mapRule(MSG_CC, 74, MSG_CC, 71),
+    mapRule(MSG_CC, 74, MSG_CC, 72),
+    mapRule(MSG_CC, 74, MSG_NOTE, 60, 1.0f, DEFAULT_NOTE_GATE),
+    mapRule(MSG_CC, 1, MSG_NOTE, 64, 1.0f, DEFAULT_NOTE_GATE),
+    mapRule(MSG_CC, 7, MSG_CC, 77, 0.8f),
+    // pc_map
+    mapRule(MSG_PC, 0, MSG_PC, 10),
+    mapRule(MSG_PC, 5, MSG_CC, 74),
+    mapRule(MSG_PC, 5, MSG_NOTE, 60, 1.0f, DEFAULT_NOTE_GATE),
+    mapRule(MSG_PC, 10, MSG_CC, 100),
+    // note_map
+    mapRule(MSG_NOTE, 60, MSG_NOTE, 64),
+    mapRule(MSG_NOTE, 62, MSG_CC, 74),
+    mapRule(MSG_NOTE, 62, MSG_NOTE, 67),
+    mapRule(MSG_NOTE, 72, MSG_CC, 76, 1.2f),
+};
+
+static_assert(rulesGrouped(DEFAULT_RULES), "Rules for the same input must be adjacent");
+
+constexpr auto DEFAULT_MAPPING = buildMapping(DEFAULT_RULES);
+
+// Function to write one default rule as a JSON mapping output
+// Uses the short forms ("12": 16, "note:45") where they compile to the same rule
+inline void defaultOutputJson(JsonVariant v, const MapRule &rule)
+{
+  static const char *const TYPE_NAMES[] = {"cc", "pc", "note"};
+  uint16_t autoGate = (rule.outType == MSG_NOTE && rule.inType != MSG_NOTE) ? DEFAULT_NOTE_GATE : 0;
+
+  if (rule.scale == 1.0f && rule.gateMs == autoGate)
+  {
+    if (rule.outType == rule.inType)
+      v.set(rule.outNumber);
+    else
+      v.set(String(TYPE_NAMES[rule.outType]) + ":" + String(rule.outNumber));
+    return;
+  }
+
+  JsonObject obj = v.to<JsonObject>();
+  obj["type"] = TYPE_NAMES[rule.outType];
+  obj["num"] = rule.outNumber;
+  if (rule.scale != 1.0f)
+    obj["scale"] = rule.scale;
+  if (rule.gateMs != autoGate)
+    obj["gate"] = rule.gateMs;
+}
+
+// Function to write the built-in mapping into a JSON document
+// Inputs with several rules become arrays
+// Returns false if the document ran out of memory
+inline bool defaultMappingDocument(JsonDocument &doc)
+{
+  const size_t count = sizeof(DEFAULT_RULES) / sizeof(DEFAULT_RULES[0]);
+  doc.clear();
+  doc["note_gate"] = DEFAULT_NOTE_GATE;
+
+  for (size_t first = 0; first < count;)
+  {
+    const MapRule &rule = DEFAULT_RULES[first];
+    size_t end = first + 1;
+    while (end < count && DEFAULT_RULES[end].inType == rule.inType && DEFAULT_RULES[end].inNumber == rule.inNumber)
+      end++;
+
+    JsonVariant entry = doc[getMappingKey(rule.inType)][String(rule.inNumber)].to<JsonVariant>();
+    if (end - first == 1)
+    {
+      defaultOutputJson(entry, rule);
+    }
+    else
+    {
+      JsonArray outputs = entry.to<JsonArray>();
+      for (size_t r = first; r < end; r++)
+        defaultOutputJson(outputs.add<JsonVariant>(), DEFAULT_RULES[r]);
+    }
+    first = end;
+  }
+  return !doc.overflowed();
+}
+
+// Function to check that defaultMappingDocument() compiles to DEFAULT_MAPPING
+// Returns the number of (type, number, value) inputs that differ
+inline uint32_t checkDefaultMapping()
+{
+  JsonDocument doc;
+  if (!defaultMappingDocument(doc))
+    return MAP_SLOTS * MAP_NUMBERS;
+  RuntimeMapping *compiled = new RuntimeMapping();
+  uint32_t diffs = MAP_SLOTS * MAP_NUMBERS;
+  if (compileMapping(doc, *compiled))
+    diffs = compareMappings(DEFAULT_MAPPING.table(), compiled->table());
+  delete compiled;
+  return diffs;
+}
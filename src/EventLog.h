@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Deferred event log
+//
+// The MIDI path never formats or prints anything: it appends fixed-size
+// binary records to a ring and moves on. A drain at the end of loop()
+// takes records out when the USB serial port has room and formats them
+// (or sends them raw to a host tool). One producer (the MIDI path) and one
+// consumer (the drain) share the ring through two indices, so neither side
+// ever waits. A full ring drops the new record and counts it.
+
+enum LogLevel : uint8_t
+{
+  LOG_OFF,   // Nothing is logged
+  LOG_ERROR, // Lost outputs
+  LOG_INFO,  // Events typed on the host, with their mapped outputs
+  LOG_DEBUG, // Every MIDI event, including DIN and load generator traffic
+  LOG_LEVEL_COUNT
+};
+
+const char *const LOG_LEVEL_NAMES[LOG_LEVEL_COUNT] = {"off", "error", "info", "debug"};
+
+enum LogKind : uint8_t
+{
+  LOG_MIDI_IN,      // Mapped input: type, number, value
+  LOG_MIDI_OUT,     // One output of the input before it: type, number, value
+  LOG_MIDI_END,     // End of the outputs of an input: value = output count
+  LOG_FORWARD,      // Unmapped message forwarded: number = length, value = status byte
+  LOG_SCHED_FULL,   // Timer wheel full: number = bytes dropped, value = status byte
+  LOG_KIND_COUNT
+};
+
+// One log record, 12 bytes (also the payload of a raw log frame)
+struct LogRecord
+{
+  uint32_t timeUs; // micros() when it was logged
+  uint8_t kind;    // LogKind
+  uint8_t source;  // MidiSource of the event
+  uint8_t type;    // MidiMessageType
+  uint8_t number;
+  uint8_t value;
+  uint8_t reserved[3];
+};
+
+static_assert(sizeof(LogRecord) == 12, "LogRecord is sent raw, keep it 12 bytes");
+
+const uint16_t LOG_RING_SIZE = 256; // Records (power of two), 3 KB
+
+class EventLog
+{
+public:
+  // Function to check whether records of a level are kept
+  // Test this before building a record, so a disabled level costs one compare
+  bool enabled(LogLevel level) const { return level <= threshold; }
+
+  // Function to append a record
+  // Returns false (and counts a drop) when the ring is full
+  bool append(uint8_t kind, uint8_t source, uint8_t type, uint8_t number, uint8_t value, uint32_t timeUs)
+  {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    if ((uint16_t)(t - head.load(std::memory_order_acquire)) >= LOG_RING_SIZE)
+    {
+      dropped++;
+      return false;
+    }
+    ring[t & (LOG_RING_SIZE - 1)] = {timeUs, kind, source, type, number, value, {0, 0, 0}};
+    tail.store(t + 1, std::memory_order_release);
+    written++;
+    return true;
+  }
+
+  // Function to take the oldest record
+  // Returns false when the ring is empty
+  bool take(LogRecord &record)
+  {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+    record = ring[h & (LOG_RING_SIZE - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  void setLevel(LogLevel level) { threshold = level; }
+  LogLevel level() const { return threshold; }
+  uint16_t pending() const { return (uint16_t)(tail.load() - head.load()); }
+  uint32_t records() const { return written; }
+  uint32_t drops() const { return dropped; }
+
+private:
+  LogRecord ring[LOG_RING_SIZE];
+  std::atomic<uint16_t> head{0}; // Next record to take (drain only)
+  std::atomic<uint16_t> tail{0}; // Next free record (MIDI path only)
+  uint32_t written = 0;          // Records appended
+  uint32_t dropped = 0;          // Records lost on a full ring
+  LogLevel threshold = LOG_INFO;
+};
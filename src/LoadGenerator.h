@@ -0,0 +1,252 @@
+#pragma once
+
+#include <Arduino.h>
+#include "MidiMerger.h"
+#include "Xorshift.h"
+
+// Synthetic MIDI load generator
+//
+// Produces traffic at a target rate and feeds it byte by byte into the
+// merger as its own source (SRC_GEN), using running status like real gear,
+// so it goes through the same parse -> map -> send path as real MIDI. Used
+// to stress a preset on the hardware ('load ...') and, at a slow rate, as
+// the demo mode. Its parser is its own, so real DIN input during a run
+// cannot break its running status. Each message is timestamped with the
+// time it was due at the target rate, so the latency of generated events
+// includes any time the loop was late in generating them.
+
+enum LoadPattern : uint8_t
+{
+  LOAD_SWEEP,  // CC sweeps on four controllers
+  LOAD_CHORDS, // Four-note chord bursts, note ons then note offs
+  LOAD_PC,     // Program change storm
+  LOAD_MIXED,  // Realistic mix: CC, notes, PC, MIDI clock
+  LOAD_DEMO,   // The mix without PC and clock, safe to send to real gear
+  LOAD_PATTERN_COUNT
+};
+
+const char *const LOAD_PATTERN_NAMES[] = {"sweep", "chords", "pc", "mixed", "demo"};
+
+// One 31250-baud MIDI port carries 3125 bytes/s
+const uint32_t LOAD_LINE_BYTES_PER_SEC = 3125;
+
+// Most messages pushed per service() call, so a large backlog cannot starve the loop
+const int LOAD_BURST = MERGER_QUEUE_SIZE;
+
+// Log2 latency buckets: bucket i counts latencies below 2^i us
+const int LOAD_LATENCY_BUCKETS = 20;
+
+class LoadGenerator
+{
+public:
+  // Function to start generating
+  // durationMs = 0 runs until stop()
+  void start(LoadPattern pattern, uint32_t rate, uint32_t durationMs, uint32_t nowUs)
+  {
+    *this = LoadGenerator();
+    this->pattern = pattern;
+    this->rate = rate;
+    this->durationMs = durationMs;
+    startUs = lastUs = nowUs;
+    rng = 0x9E3779B9 ^ nowUs;
+    active = true;
+  }
+
+  // Function to stop generating; the report stays available
+  void stop(uint32_t nowUs)
+  {
+    if (!active)
+      return;
+    active = false;
+    elapsedUs = nowUs - startUs;
+  }
+
+  // Function to push the messages that are due into the merger
+  // Returns true while running, false once the duration is over
+  bool service(MidiMerger &merger, uint32_t nowUs)
+  {
+    if (!active)
+      return false;
+
+    if (durationMs > 0 && (nowUs - startUs) / 1000 >= durationMs)
+    {
+      stop(nowUs);
+      return false;
+    }
+
+    // Messages owed at the target rate; a backlog is caught up in bursts
+    credit += (uint64_t)(nowUs - lastUs) * rate;
+    lastUs = nowUs;
+    for (int burst = 0; credit >= 1000000 && burst < LOAD_BURST; burst++)
+    {
+      credit -= 1000000;
+      uint32_t dueUs = nowUs - (uint32_t)(credit / rate); // The rest of the credit built up after it was due
+      MidiMessage msg = next();
+      generated++;
+      if (!merger.hasSpace(SRC_GEN))
+      {
+        dropped++;
+        continue;
+      }
+
+      // Repeated status bytes are left out; real-time bytes keep running status
+      bool realTime = msg.bytes[0] >= 0xF8;
+      int first = (!realTime && msg.bytes[0] == runningStatus) ? 1 : 0;
+      for (int i = first; i < msg.length; i++)
+        merger.feed(SRC_GEN, msg.bytes[i], dueUs);
+      if (!realTime)
+        runningStatus = msg.bytes[0] < 0xF0 ? msg.bytes[0] : 0;
+      injected++;
+      bytes += msg.length - first;
+    }
+    return true;
+  }
+
+  // Function to record the latency of one handled generator event
+  // (from its due time until its outputs were sent or scheduled)
+  void recordLatency(uint32_t latencyUs)
+  {
+    if (!active)
+      return;
+    handled++;
+    latencySumUs += latencyUs;
+    if (latencyUs > latencyMaxUs)
+      latencyMaxUs = latencyUs;
+    int bucket = 0;
+    while (bucket < LOAD_LATENCY_BUCKETS - 1 && latencyUs >= (1UL << bucket))
+      bucket++;
+    latencyBuckets[bucket]++;
+  }
+
+  bool running() const { return active; }
+
+  // Function to print throughput, drops and latency of the last run
+  // bytesOut is the number of MIDI bytes sent during the run
+  void printReport(uint32_t bytesOut) const
+  {
+    uint32_t runUs = elapsedUs ? elapsedUs : 1;
+    uint32_t achieved = (uint64_t)injected * 1000000 / runUs;
+    uint32_t bytesPerSec = (uint64_t)bytes * 1000000 / runUs;
+    uint32_t outPerSec = (uint64_t)bytesOut * 1000000 / runUs;
+
+    Serial.println("\n=== Load Test ===");
+    Serial.printf("Pattern        : %s @ %lu msg/s for %lu ms\n", LOAD_PATTERN_NAMES[pattern], (unsigned long)rate,
+                  (unsigned long)(runUs / 1000));
+    Serial.printf("Generated      : %lu (%lu injected, %lu dropped on full queue, %lu behind)\n",
+                  (unsigned long)generated, (unsigned long)injected, (unsigned long)dropped,
+                  (unsigned long)(credit / 1000000));
+    Serial.printf("Achieved       : %lu msg/s, %lu bytes/s in (%lu%% of line rate)\n", (unsigned long)achieved,
+                  (unsigned long)bytesPerSec, (unsigned long)(bytesPerSec * 100 / LOAD_LINE_BYTES_PER_SEC));
+    Serial.printf("MIDI out       : %lu bytes, %lu bytes/s (%lu%% of line rate)\n", (unsigned long)bytesOut,
+                  (unsigned long)outPerSec, (unsigned long)(outPerSec * 100 / LOAD_LINE_BYTES_PER_SEC));
+    if (handled > 0)
+    {
+      Serial.printf("Latency        : avg %lu us, p99 < %lu us, max %lu us (%lu handled)\n",
+                    (unsigned long)(latencySumUs / handled), (unsigned long)latencyPercentile(99),
+                    (unsigned long)latencyMaxUs, (unsigned long)handled);
+    }
+    Serial.println("=================\n");
+  }
+
+private:
+  // Function to produce the next message of the pattern
+  MidiMessage next()
+  {
+    static const uint8_t SWEEP_CCS[] = {1, 7, 11, 74};
+    static const uint8_t CHORD[] = {0, 4, 7, 12};
+    uint32_t k = generated;
+
+    switch (pattern)
+    {
+    case LOAD_SWEEP:
+    {
+      // All four controllers ramp up and down together
+      uint8_t step = (k / 4) % 254;
+      uint8_t value = step < 127 ? step : 254 - step;
+      return {{0xB0, SWEEP_CCS[k % 4], value}, 3};
+    }
+
+    case LOAD_CHORDS:
+    {
+      // Note ons of a chord, then its note offs
+      if (k % 8 == 0)
+        chordRoot = 48 + xorshift32(rng) % 25;
+      uint8_t note = chordRoot + CHORD[k % 4];
+      if (k % 8 < 4)
+        return {{0x90, note, (uint8_t)(64 + xorshift32(rng) % 64)}, 3};
+      return {{0x80, note, 0}, 3};
+    }
+
+    case LOAD_PC:
+      return {{0xC0, (uint8_t)(xorshift32(rng) % 128), 0}, 2};
+
+    case LOAD_MIXED:
+    case LOAD_DEMO:
+    default:
+    {
+      // The demo plays to whatever is connected: no program changes or clock
+      uint32_t r = pattern == LOAD_DEMO ? 8 + xorshift32(rng) % 92 : xorshift32(rng) % 100;
+      if (r < 5)
+        return {{0xF8, 0, 0}, 1}; // MIDI clock
+      if (r < 8)
+        return {{0xC0, (uint8_t)(xorshift32(rng) % 16), 0}, 2};
+      if (r < 40)
+      {
+        // Play and release notes in turn
+        if (heldNote != 0)
+        {
+          uint8_t note = heldNote;
+          heldNote = 0;
+          return {{0x80, note, 0}, 3};
+        }
+        heldNote = 36 + xorshift32(rng) % 61;
+        return {{0x90, heldNote, (uint8_t)(32 + xorshift32(rng) % 96)}, 3};
+      }
+      // Controllers drifting like a hand on a fader
+      int cc = xorshift32(rng) % 4;
+      int step = (int)(xorshift32(rng) % 9) - 4; // Outside constrain(): it is a macro
+      ccValues[cc] = constrain((int)ccValues[cc] + step, 0, 127);
+      return {{0xB0, SWEEP_CCS[cc], ccValues[cc]}, 3};
+    }
+    }
+  }
+
+  // Function to estimate a latency percentile from the buckets (upper bound)
+  uint32_t latencyPercentile(int percent) const
+  {
+    uint32_t target = ((uint64_t)handled * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int b = 0; b < LOAD_LATENCY_BUCKETS; b++)
+    {
+      seen += latencyBuckets[b];
+      if (seen >= target)
+        return 1UL << b;
+    }
+    return latencyMaxUs;
+  }
+
+  LoadPattern pattern = LOAD_MIXED;
+  uint32_t rate = 0;       // Messages per second
+  uint32_t durationMs = 0; // 0 = until stopped
+  uint32_t startUs = 0;
+  uint32_t lastUs = 0;
+  uint32_t elapsedUs = 0;
+  uint64_t credit = 0;     // Messages owed, times 10^6
+  bool active = false;
+
+  uint32_t generated = 0; // Messages produced
+  uint32_t injected = 0;  // Messages accepted by the merger
+  uint32_t dropped = 0;   // Messages lost on a full input queue
+  uint32_t bytes = 0;     // Bytes injected (after running status)
+  uint8_t runningStatus = 0; // Last status byte fed, 0 = none
+  uint32_t handled = 0;   // Messages mapped and sent while running
+
+  uint64_t latencySumUs = 0;
+  uint32_t latencyMaxUs = 0;
+  uint32_t latencyBuckets[LOAD_LATENCY_BUCKETS] = {};
+
+  uint32_t rng = 1;
+  uint8_t chordRoot = 60;
+  uint8_t heldNote = 0;
+  uint8_t ccValues[4] = {64, 64, 64, 64};
+};
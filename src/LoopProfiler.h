@@ -0,0 +1,186 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Main-loop CPU profiler
+//
+// Charges CPU cycles to the pipeline stage that is running, using the
+// cycle counter. Stages switch with enter()/leave(), which nest: a stage
+// entered from inside another one pauses it. A stage that polled and found
+// nothing to do hands its time to idle, so the load figure shows real work
+// rather than the cost of spinning. Totals roll over in fixed windows; the
+// last windows are kept for averages and peaks.
+
+enum ProfileStage : uint8_t
+{
+  STAGE_IDLE,     // Polls with nothing to do, loop overhead
+  STAGE_MIDI_IN,  // Reading, parsing and merging MIDI input
+  STAGE_MAPPING,  // applyMapping() and scheduling outputs
+  STAGE_MIDI_OUT, // Writing to the MIDI port
+  STAGE_TIMERS,   // Firing delayed outputs
+  STAGE_COMMANDS, // Serial commands
+  STAGE_DISPLAY,  // Display redraws
+  STAGE_LED,      // LED indicator
+  STAGE_LOAD_GEN, // Synthetic load generator
+  STAGE_LOG,      // Printing logged events
+  STAGE_COUNT
+};
+
+const char *const PROFILE_STAGE_NAMES[STAGE_COUNT] = {
+    "Idle/other", "MIDI in", "Mapping", "MIDI out", "Timers", "Commands", "Display", "LED", "Load gen", "Log"};
+
+const uint32_t PROFILE_WINDOW_MS = 1000; // Length of one window
+const int PROFILE_HISTORY = 10;          // Windows kept for averages and peaks
+
+class LoopProfiler
+{
+public:
+  // Totals of one window
+  struct Window
+  {
+    uint32_t cycles[STAGE_COUNT]; // Cycles per stage
+    uint32_t total;               // Cycles in the window
+    uint32_t loops;               // loop() iterations
+    uint32_t worstLoopCycles;     // Longest loop() iteration
+  };
+
+  // Function to mark the start of a loop() iteration
+  // Tracks the loop period and rolls the window over when it is full
+  void loopStart()
+  {
+    uint32_t now = cycles();
+    if (!started)
+    {
+      started = true;
+      acc = {};
+      windowStart = lastLoop = lastSwitch = now;
+      cyclesPerUs = ESP.getCpuFreqMHz();
+      return;
+    }
+
+    uint32_t period = now - lastLoop;
+    lastLoop = now;
+    acc.loops++;
+    if (period > acc.worstLoopCycles)
+      acc.worstLoopCycles = period;
+
+    if (now - windowStart >= PROFILE_WINDOW_MS * 1000 * cyclesPerUs)
+      rollWindow(now);
+  }
+
+  // Function to switch to a stage
+  // Returns the stage that was running, to hand to leave()
+  ProfileStage enter(ProfileStage stage)
+  {
+    charge(current); // The interrupted stage did work, or it would not call us
+    ProfileStage previous = current;
+    current = stage;
+    return previous;
+  }
+
+  // Function to return from a stage to the one that was running before
+  // worked = false hands the time to idle (the stage only polled)
+  void leave(ProfileStage previous, bool worked = true)
+  {
+    charge(worked ? current : STAGE_IDLE);
+    current = previous;
+  }
+
+  // Function to clear all windows and the worst loop period
+  void reset()
+  {
+    started = false;
+    windowCount = 0;
+    worstLoopEverCycles = 0;
+  }
+
+  // Function to get the CPU load of a window in tenths of a percent
+  static uint32_t loadPermille(const Window &w)
+  {
+    if (w.total == 0)
+      return 0;
+    return (uint64_t)(w.total - w.cycles[STAGE_IDLE]) * 1000 / w.total;
+  }
+
+  // Function to get the most recent complete window
+  // Returns false before the first window is complete
+  bool lastWindow(Window &w) const
+  {
+    if (windowCount == 0)
+      return false;
+    w = history[(windowCount - 1) % PROFILE_HISTORY];
+    return true;
+  }
+
+  // Function to get the average and peak load over the kept windows
+  void historyLoad(uint32_t &avgPermille, uint32_t &peakPermille) const
+  {
+    int count = windowCount < PROFILE_HISTORY ? windowCount : PROFILE_HISTORY;
+    uint32_t sum = 0;
+    peakPermille = 0;
+    for (int i = 0; i < count; i++)
+    {
+      uint32_t load = loadPermille(history[i]);
+      sum += load;
+      if (load > peakPermille)
+        peakPermille = load;
+    }
+    avgPermille = count ? sum / count : 0;
+  }
+
+  // Function to count completed windows (use to redraw once per window)
+  uint32_t windows() const { return windowCount; }
+  uint32_t worstLoopEverUs() const { return cyclesPerUs ? worstLoopEverCycles / cyclesPerUs : 0; }
+  uint32_t toUs(uint32_t c) const { return cyclesPerUs ? c / cyclesPerUs : 0; }
+
+  // Function to read the cycle counter
+  static inline uint32_t cycles() { return ESP.getCycleCount(); }
+
+private:
+  // Function to charge the cycles since the last switch to a stage
+  void charge(ProfileStage stage)
+  {
+    uint32_t now = cycles();
+    acc.cycles[stage] += now - lastSwitch;
+    lastSwitch = now;
+  }
+
+  // Function to close the current window and start a new one
+  void rollWindow(uint32_t now)
+  {
+    charge(current);
+    acc.total = now - windowStart;
+    if (acc.worstLoopCycles > worstLoopEverCycles)
+      worstLoopEverCycles = acc.worstLoopCycles;
+    history[windowCount % PROFILE_HISTORY] = acc;
+    windowCount++;
+    acc = {};
+    windowStart = now;
+  }
+
+  Window acc = {};                   // Window being filled
+  Window history[PROFILE_HISTORY] = {};
+  uint32_t windowCount = 0;          // Completed windows
+  uint32_t windowStart = 0;          // Cycle count at the start of the window
+  uint32_t lastSwitch = 0;           // Cycle count at the last stage switch
+  uint32_t lastLoop = 0;             // Cycle count at the last loopStart()
+  uint32_t worstLoopEverCycles = 0;  // Since reset
+  uint32_t cyclesPerUs = 160;
+  ProfileStage current = STAGE_IDLE;
+  bool started = false;
+};
+
+// Scope that charges the time until the end of the block to a stage
+// Set worked = false when the stage found nothing to do
+class StageScope
+{
+public:
+  StageScope(LoopProfiler &profiler, ProfileStage stage) : profiler(profiler), previous(profiler.enter(stage)) {}
+  ~StageScope() { profiler.leave(previous, worked); }
+
+  bool worked = true;
+
+private:
+  LoopProfiler &profiler;
+  ProfileStage previous;
+};
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include "MidiParser.h"
+#include "Xorshift.h"
+#include "MappingCompiler.h"
+#include "ReferenceMapping.h"
+
+// Random mapping input and engine comparison
+//
+// Shared by the on-device checks ('fuzz', 'bench patch') and the native
+// tests in test/. Nothing here prints or reads the clock, so it also builds
+// on the host; callers do their own reporting.
+//
+// Known, intended difference: the reference stops arrays after 10 outputs,
+// the compiled engine does not. Those inputs are compared on the first 10
+// outputs and counted separately.
+
+const int FUZZ_STREAM_BYTES = 256;  // Random MIDI bytes per document
+
+struct FuzzStats
+{
+  uint32_t docs;
+  uint32_t inputs;      // Mappable messages decoded from the streams
+  uint32_t mapped;      // Inputs the reference mapped (not pass-through)
+  uint32_t outputs;     // Outputs compared
+  uint32_t capped;      // Inputs past the reference's 10-output cap
+  uint32_t outOfRange;  // Inputs whose mapping targets a number outside 0-127 (findings)
+  uint32_t divergences; // Inputs where the engines disagree
+};
+
+// Function to pick a random number below n
+inline uint32_t fuzzPick(uint32_t &rng, uint32_t n)
+{
+  return xorshift32(rng) % n;
+}
+
+// Function to make a random mapping string: "note:45", "foo:12", "45", "note:200", ...
+inline String fuzzString(uint32_t &rng)
+{
+  static const char *const TYPES[] = {"cc", "pc", "note", "nn", "NOTE", "Cc", "foo", ""};
+  static const char *const NUMBERS[] = {"0", "45", "127", "128", "200", "255", "300", "-3", "x", "12abc", " 7"};
+
+  switch (fuzzPick(rng, 4))
+  {
+  case 0:
+    return NUMBERS[fuzzPick(rng, 11)]; // No colon
+  case 1:
+    return String(TYPES[fuzzPick(rng, 8)]) + ":" + NUMBERS[fuzzPick(rng, 11)];
+  case 2:
+    return String(TYPES[fuzzPick(rng, 8)]) + ":" + String(fuzzPick(rng, 16));
+  default:
+    return "note:" + String(fuzzPick(rng, 256));
+  }
+}
+
+// Function to fill a variant with a random scalar: number, float, bool, null or string
+inline void fuzzScalar(JsonVariant v, uint32_t &rng)
+{
+  switch (fuzzPick(rng, 8))
+  {
+  case 0:
+  case 1:
+    v.set((int)fuzzPick(rng, 16));
+    break;
+  case 2:
+    v.set((int)fuzzPick(rng, 400) - 50); // Negative and > 255 too
+    break;
+  case 3:
+    v.set(fuzzPick(rng, 100) / 4.0f);
+    break;
+  case 4:
+    v.set(fuzzPick(rng, 2) == 0);
+    break;
+  case 5:
+    break; // null
+  default:
+    v.set(fuzzString(rng));
+    break;
+  }
+}
+
+// Function to fill an object mapping with random type/num/scale/velocity
+inline void fuzzObject(JsonObject obj, uint32_t &rng)
+{
+  static const char *const TYPES[] = {"cc", "pc", "note", "nn", "Note", "bogus"};
+  static const float SCALES[] = {0.0f, 0.5f, 0.8f, 1.0f, 1.2f, 2.5f, -1.0f};
+
+  if (fuzzPick(rng, 4) != 0)
+  {
+    if (fuzzPick(rng, 8) == 0)
+      obj["type"] = 5;
+    else
+      obj["type"] = TYPES[fuzzPick(rng, 6)];
+  }
+
+  switch (fuzzPick(rng, 6))
+  {
+  case 0:
+    break; // No "num": defaults to the input number
+  case 1:
+    obj["num"] = fuzzPick(rng, 300);
+    break;
+  case 2:
+    obj["num"] = 12.5f;
+    break;
+  case 3:
+    obj["num"] = String(fuzzPick(rng, 16));
+    break;
+  default:
+    obj["num"] = fuzzPick(rng, 16);
+    break;
+  }
+
+  if (fuzzPick(rng, 3) == 0)
+    obj["scale"] = SCALES[fuzzPick(rng, 7)];
+  if (fuzzPick(rng, 3) == 0)
+    obj["velocity"] = SCALES[fuzzPick(rng, 7)];
+  if (fuzzPick(rng, 8) == 0)
+    obj["scale"] = "0.5"; // String, not a number
+  if (fuzzPick(rng, 8) == 0)
+    obj["junk"] = 1;
+}
+
+// Function to fill a variant with a random mapping entry
+inline void fuzzEntry(JsonVariant v, uint32_t &rng)
+{
+  uint32_t kind = fuzzPick(rng, 10);
+  if (kind < 4)
+  {
+    fuzzScalar(v, rng);
+  }
+  else if (kind < 7)
+  {
+    // Arrays, sometimes longer than the reference's 10-output cap,
+    // sometimes with nested arrays (ignored by both engines)
+    JsonArray arr = v.to<JsonArray>();
+    int length = fuzzPick(rng, 15);
+    for (int i = 0; i < length; i++)
+    {
+      if (fuzzPick(rng, 16) == 0)
+        arr.add<JsonArray>().add(fuzzPick(rng, 16));
+      else
+        fuzzScalar(arr.add<JsonVariant>(), rng);
+    }
+  }
+  else
+  {
+    fuzzObject(v.to<JsonObject>(), rng);
+  }
+}
+
+// Function to make a random mapping document in the original format
+inline void fuzzDocument(JsonDocument &doc, uint32_t &rng)
+{
+  static const char *const ODD_KEYS[] = {"007", "-1", "128", "200", "abc", "", " 5"};
+
+  doc.clear();
+  for (int t = 0; t < MAP_TYPES; t++)
+  {
+    String mapKey = getMappingKey((MidiMessageType)t);
+    uint32_t shape = fuzzPick(rng, 8);
+    if (shape == 0)
+      continue; // No map for this type
+    if (shape == 1)
+    {
+      doc[mapKey] = 5; // Not an object
+      continue;
+    }
+
+    JsonObject map = doc[mapKey].to<JsonObject>();
+    int entries = fuzzPick(rng, 12);
+    for (int e = 0; e < entries; e++)
+    {
+      uint32_t keyKind = fuzzPick(rng, 10);
+      String key;
+      if (keyKind == 0)
+        key = ODD_KEYS[fuzzPick(rng, 7)];
+      else if (keyKind == 1)
+        key = String(fuzzPick(rng, 128));
+      else
+        key = String(fuzzPick(rng, 16)); // Small keys, so the streams hit them
+      fuzzEntry(map[key].to<JsonVariant>(), rng);
+    }
+  }
+}
+
+// Function to produce one random MIDI byte
+// Mostly CC/PC/note status bytes and small data bytes, with some of everything else
+inline uint8_t fuzzMidiByte(uint32_t &rng)
+{
+  static const uint8_t STATUS[] = {0x80, 0x90, 0xB0, 0xC0};
+  uint32_t r = fuzzPick(rng, 20);
+  if (r < 4)
+    return STATUS[fuzzPick(rng, 4)] | fuzzPick(rng, 16);
+  if (r < 5)
+    return 0x80 | fuzzPick(rng, 128); // Any status, real-time, SysEx
+  if (r < 14)
+    return fuzzPick(rng, 16);
+  return fuzzPick(rng, 128);
+}
+
+// Function to fill a variant with a random mapping entry
+// Covers every entry form: numbers, type strings, arrays, objects and layers
+inline void randomEntry(JsonVariant v, uint32_t &rng)
+{
+  static const char *const TYPES[] = {"cc", "pc", "note"};
+  static const float SCALES[] = {0.5f, 0.8f, 1.0f, 1.2f};
+
+  switch (xorshift32(rng) % 6)
+  {
+  case 0:
+    v.set(xorshift32(rng) % 128);
+    break;
+  case 1:
+    v.set(String(TYPES[xorshift32(rng) % 3]) + ":" + String(xorshift32(rng) % 128));
+    break;
+  case 2:
+  {
+    JsonArray outs = v.to<JsonArray>();
+    for (int i = xorshift32(rng) % 4; i >= 0; i--)
+      outs.add(xorshift32(rng) % 128);
+    outs.add(String(TYPES[xorshift32(rng) % 3]) + ":" + String(xorshift32(rng) % 128));
+    break;
+  }
+  case 3:
+  {
+    JsonObject obj = v.to<JsonObject>();
+    obj["type"] = TYPES[xorshift32(rng) % 3];
+    obj["num"] = xorshift32(rng) % 128;
+    obj["scale"] = SCALES[xorshift32(rng) % 4];
+    obj["delay"] = (xorshift32(rng) % 4) * 50;
+
+    // CC redundancy suppression, on its own or combined
+    switch (xorshift32(rng) % 4)
+    {
+    case 0:
+      obj["dedupe"] = true;
+      break;
+    case 1:
+      obj["deadband"] = xorshift32(rng) % 8;
+      break;
+    case 2:
+      obj["max_rate"] = 1 + xorshift32(rng) % 200;
+      break;
+    default:
+      break;
+    }
+    break;
+  }
+  case 4:
+  {
+    // Velocity layers
+    JsonArray layers = v.to<JsonArray>();
+    int split = 1 + xorshift32(rng) % 126;
+    JsonObject soft = layers.add<JsonObject>();
+    soft["num"] = xorshift32(rng) % 128;
+    soft["max"] = split - 1;
+    JsonObject hard = layers.add<JsonObject>();
+    hard["num"] = xorshift32(rng) % 128;
+    hard["min"] = split;
+    break;
+  }
+  default:
+  {
+    JsonObject obj = v.to<JsonObject>();
+    obj["offset"] = (int)(xorshift32(rng) % 25) - 12;
+    obj["min"] = xorshift32(rng) % 64;
+    break;
+  }
+  }
+}
+
+// Function to build a random set/rep/del patch request
+inline void randomPatch(JsonDocument &request, uint32_t &rng)
+{
+  static const char *const OPS[] = {"set", "set", "rep", "del"};
+
+  request.clear();
+  request["op"] = OPS[xorshift32(rng) % 4];
+  request["map"] = getMappingKey((MidiMessageType)(xorshift32(rng) % MAP_TYPES));
+  uint32_t keyKind = xorshift32(rng) % 8;
+  if (keyKind == 0)
+  {
+    int lo = xorshift32(rng) % 128;
+    int hi = lo + xorshift32(rng) % (128 - lo);
+    request["key"] = String(lo) + "-" + String(hi);
+  }
+  else
+  {
+    // Few keys, so replacing and deleting existing entries is common
+    int n = xorshift32(rng) % 24;
+    if (keyKind & 1)
+      request["key"] = n;
+    else
+      request["key"] = String(n);
+  }
+  randomEntry(request["val"].to<JsonVariant>(), rng);
+}
+
+// Function to compare both engines on one input
+// A reference output with a number outside 0-127 is a finding: the compiler
+// must have skipped it, so it is left out of the comparison and counted.
+// Returns false if the engines disagree. report(midi, reference,
+// referenceCount, referenceMapped, compiledMapped, same) is called for
+// divergences and findings.
+template <typename Report>
+bool fuzzCompare(JsonDocument &doc, const MappingTable &table, const MidiData &midi, std::vector<MappedOutput> &compiled, FuzzStats &stats, Report report)
+{
+  MappedOutput reference[REFERENCE_MAX_OUTPUTS];
+  int referenceCount = 0;
+  bool referenceMapped = referenceMapping(doc, midi, reference, referenceCount);
+
+  compiled.clear();
+  bool compiledMapped = mapMessage(table, midi, nullptr, [&](const MappedOutput &out)
+                                   { compiled.push_back(out); });
+
+  stats.inputs++;
+  if (referenceMapped)
+    stats.mapped++;
+
+  MappedOutput expected[REFERENCE_MAX_OUTPUTS];
+  int expectedCount = 0;
+  bool outOfRange = false;
+  for (int i = 0; i < referenceCount; i++)
+  {
+    if (reference[i].number == REFERENCE_OUT_OF_RANGE)
+      outOfRange = true;
+    else
+      expected[expectedCount++] = reference[i];
+  }
+  if (outOfRange)
+    stats.outOfRange++;
+
+  // The reference stopped at 10 array outputs; compare those
+  int count = compiled.size();
+  if (referenceCount == REFERENCE_MAX_OUTPUTS && count > expectedCount)
+  {
+    stats.capped++;
+    count = expectedCount;
+  }
+
+  // Compare what goes on the wire, unmasked: a number or value above 127
+  // from the compiled tables never matches
+  bool same = referenceMapped == compiledMapped && count == expectedCount;
+  for (int i = 0; same && i < count; i++)
+  {
+    const MappedOutput &c = compiled[i];
+    const MappedOutput &r = expected[i];
+    same = c.type == r.type && c.number == r.number && c.value == r.value &&
+           c.delayMs == 0 && c.gateMs == 0 && c.repeat == 0 && c.deadband == THIN_OFF;
+    stats.outputs++;
+  }
+  if (!same)
+    stats.divergences++;
+  if (!same || outOfRange)
+    report(midi, reference, referenceCount, referenceMapped, compiledMapped, same);
+  return same;
+}
+
+// Function to map a random MIDI byte stream with both engines
+// Every mappable message the parser completes goes through fuzzCompare()
+template <typename Report>
+void fuzzStream(JsonDocument &doc, const MappingTable &table, uint32_t &rng, std::vector<MappedOutput> &compiled, FuzzStats &stats, Report report)
+{
+  MidiParser parser;
+  for (int b = 0; b < FUZZ_STREAM_BYTES; b++)
+  {
+    MidiMessage msg;
+    MidiData midi;
+    if (parser.feed(fuzzMidiByte(rng), msg) && decodeMidiMessage(msg, SRC_DIN, midi))
+      fuzzCompare(doc, table, midi, compiled, stats, report);
+  }
+}
@@ -0,0 +1,526 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "MappingTable.h"
+
+// JSON -> compiled mapping tables
+//
+// Walks a mapping document once at load time and produces the same outputs
+// the JSON interpreter used to produce per message, so the hot path only
+// has to index a table.
+
+// Function to get mapping key based on message type
+inline String getMappingKey(MidiMessageType type)
+{
+  switch (type)
+  {
+  case MSG_CC:
+    return "cc_map";
+  case MSG_PC:
+    return "pc_map";
+  case MSG_NOTE:
+    return "note_map";
+  default:
+    return "";
+  }
+}
+
+// Function to parse an output type name ("cc", "pc", "note"/"nn")
+// Unknown names keep the input type
+inline MidiMessageType parseTypeName(String typeStr, MidiMessageType inputType)
+{
+  typeStr.toLowerCase();
+  if (typeStr == "cc")
+    return MSG_CC;
+  if (typeStr == "pc")
+    return MSG_PC;
+  if (typeStr == "note" || typeStr == "nn")
+    return MSG_NOTE;
+  return inputType;
+}
+
+// Function to parse an input source name ("din", "usb") into a source mask
+// Unknown names match any source
+inline uint8_t parseSourceMask(String sourceStr)
+{
+  sourceStr.toLowerCase();
+  if (sourceStr == "din")
+    return 1 << SRC_DIN;
+  if (sourceStr == "usb")
+    return 1 << SRC_USB;
+  return 0;
+}
+
+// Function to read an optional millisecond field of an object mapping
+inline uint16_t readMs(JsonObject obj, const char *key, uint16_t defaultMs)
+{
+  int ms = obj[key] | (int)defaultMs;
+  return constrain(ms, 0, 65535);
+}
+
+// Output together with the input value range it reacts to
+struct ConditionalOutput
+{
+  CompiledOutput out;
+  uint8_t minValue;
+  uint8_t maxValue;
+};
+
+// Function to make a plain output (no scaling or timing, any value)
+// Note outputs get the automatic gate
+inline ConditionalOutput simpleOutput(MidiMessageType type, uint8_t number, uint16_t autoGate, uint8_t value = VALUE_FROM_INPUT)
+{
+  uint16_t gate = (type == MSG_NOTE) ? autoGate : 0;
+  return {{1.0f, 0, gate, 0, (uint8_t)type, 0, number, value, 0, THIN_OFF, 0}, 0, 127};
+}
+
+// Function to add a plain output if its number is a MIDI data byte
+// Numbers outside 0-127 ("note:200", -3) are skipped and counted in rejected
+// Returns the number of outputs added
+inline int addSimpleOutput(std::vector<ConditionalOutput> &rules, MidiMessageType inType, MidiMessageType type, long number,
+                           uint16_t autoGate, uint32_t &rejected)
+{
+  if (number < 0 || number > 127)
+  {
+    rejected++;
+    return 0;
+  }
+  rules.push_back(simpleOutput(type, number, autoGate, defaultOutputValue(inType, type)));
+  return 1;
+}
+
+// Function to compile an object mapping: "12": {"type": "note", "num": 60, "scale": 0.5}
+// "num" may also be an array: one output per number, all with the same transform
+// Outputs with a number outside 0-127 are skipped and counted in rejected
+// Returns the number of outputs added
+inline int compileObject(JsonObject obj, MidiMessageType inType, uint8_t inNumber, uint16_t autoGate,
+                         std::vector<ConditionalOutput> &rules, uint32_t &rejected)
+{
+  MidiMessageType type = inType;
+  if (obj.containsKey("type"))
+    type = parseTypeName(obj["type"].as<String>(), inType);
+
+  int number = obj["num"] | (int)inNumber; // Default to input if not specified
+
+  // "offset" shifts the input number (key splits); results outside 0-127 are dropped
+  if (!obj.containsKey("num") && obj.containsKey("offset"))
+  {
+    int shifted = inNumber + (obj["offset"] | 0);
+    if (shifted < 0 || shifted > 127)
+      return 0;
+    number = shifted;
+  }
+
+  // "min"/"max": only react to input values (CC value, velocity) in this range
+  int minValue = obj["min"] | 0;
+  int maxValue = obj["max"] | 127;
+  minValue = constrain(minValue, 0, 127);
+  maxValue = constrain(maxValue, 0, 127);
+  if (minValue > maxValue)
+    return 0;
+
+  // "scale" takes precedence over "velocity"
+  float scale = 1.0f;
+  if (obj.containsKey("scale"))
+    scale = obj["scale"];
+  else if (obj.containsKey("velocity"))
+    scale = obj["velocity"];
+
+  // Timing: "delay" before sending, "gate" note length, "repeat"/"interval" echoes
+  // "value": fixed output value (note velocity, CC value) instead of the scaled input
+  uint8_t value = defaultOutputValue(inType, type);
+  if (obj["value"].is<int>())
+  {
+    int fixed = obj["value"];
+    value = constrain(fixed, 0, 127);
+  }
+
+  CompiledOutput out = {scale, 0, 0, 0, (uint8_t)type, 0, (uint8_t)number, value, 0, THIN_OFF, 0};
+  out.delayMs = readMs(obj, "delay", 0);
+  out.gateMs = (type == MSG_NOTE) ? readMs(obj, "gate", autoGate) : 0;
+  int repeat = obj["repeat"] | 0;
+  out.repeat = constrain(repeat, 0, MAX_REPEATS);
+  out.intervalMs = readMs(obj, "interval", 0);
+
+  // "source": only react to input from "din" or "usb"
+  if (obj.containsKey("source"))
+    out.sources = parseSourceMask(obj["source"].as<String>());
+
+  // CC redundancy suppression: "dedupe" drops unchanged values, "deadband"
+  // also drops small changes, "max_rate" limits updates per second
+  bool thin = obj["dedupe"] | false;
+  if (obj.containsKey("deadband") || obj.containsKey("max_rate"))
+    thin = true;
+  if (thin && type == MSG_CC)
+  {
+    int deadband = obj["deadband"] | 0;
+    out.deadband = constrain(deadband, 0, 127);
+    int maxRate = obj["max_rate"] | 0;
+    if (maxRate > 0)
+      out.minGapMs = constrain(1000 / maxRate, 1, 255);
+  }
+
+  if (obj["num"].is<JsonArray>())
+  {
+    int count = 0;
+    for (JsonVariant v : obj["num"].as<JsonArray>())
+    {
+      if (!v.is<int>())
+        continue;
+      int n = v.as<int>();
+      if (n < 0 || n > 127)
+      {
+        rejected++;
+        continue;
+      }
+      out.number = n;
+      rules.push_back({out, (uint8_t)minValue, (uint8_t)maxValue});
+      count++;
+    }
+    return count;
+  }
+
+  if (number < 0 || number > 127)
+  {
+    rejected++;
+    return 0;
+  }
+  rules.push_back({out, (uint8_t)minValue, (uint8_t)maxValue});
+  return 1;
+}
+
+// Function to compile one mapping entry into conditional outputs
+// autoGate is the note off delay given to note outputs without their own gate
+// Outputs with a number outside 0-127 are skipped and counted in rejected
+// Returns the number of outputs added
+inline int compileEntry(JsonVariant mapping, MidiMessageType inType, uint8_t inNumber, uint16_t autoGate,
+                        std::vector<ConditionalOutput> &rules, uint32_t &rejected)
+{
+  if (mapping.is<int>())
+  {
+    // Simple number mapping: "12": 16 (same type)
+    return addSimpleOutput(rules, inType, inType, mapping.as<int>(), autoGate, rejected);
+  }
+
+  if (mapping.is<String>())
+  {
+    // String mapping for type conversion: "23": "note:45"
+    String mapStr = mapping.as<String>();
+    int colonPos = mapStr.indexOf(':');
+
+    if (colonPos > 0)
+    {
+      MidiMessageType type = parseTypeName(mapStr.substring(0, colonPos), inType);
+      return addSimpleOutput(rules, inType, type, mapStr.substring(colonPos + 1).toInt(), autoGate, rejected);
+    }
+
+    // No colon, treat as number
+    return addSimpleOutput(rules, inType, inType, mapStr.toInt(), autoGate, rejected);
+  }
+
+  if (mapping.is<JsonArray>())
+  {
+    // Array mapping (one-to-many): "12": [16, 17, "note:60", {"num": 18, "min": 64}]
+    // No limit on the number of outputs
+    int count = 0;
+    for (JsonVariant v : mapping.as<JsonArray>())
+    {
+      if (v.is<int>())
+      {
+        count += addSimpleOutput(rules, inType, inType, v.as<int>(), autoGate, rejected);
+      }
+      else if (v.is<String>())
+      {
+        // Inside arrays, strings without a colon are ignored
+        String mapStr = v.as<String>();
+        int colonPos = mapStr.indexOf(':');
+        if (colonPos > 0)
+        {
+          MidiMessageType type = parseTypeName(mapStr.substring(0, colonPos), inType);
+          count += addSimpleOutput(rules, inType, type, mapStr.substring(colonPos + 1).toInt(), autoGate, rejected);
+        }
+      }
+      else if (v.is<JsonObject>())
+      {
+        // Objects give each output its own transform and value range
+        count += compileObject(v.as<JsonObject>(), inType, inNumber, autoGate, rules, rejected);
+      }
+    }
+    return count;
+  }
+
+  if (mapping.is<JsonObject>())
+    return compileObject(mapping.as<JsonObject>(), inType, inNumber, autoGate, rules, rejected);
+
+  // Any other value (null, float, bool) maps to nothing
+  return 0;
+}
+
+// Function to check if a conditional output reacts to an input value
+inline bool coversValue(const ConditionalOutput &rule, int value)
+{
+  return value >= rule.minValue && value <= rule.maxValue;
+}
+
+// Function to find an identical zone map or add a new one
+// Returns its index
+inline uint16_t addZoneMap(std::vector<uint8_t> &zoneMaps, const uint8_t zoneOf[MAP_NUMBERS])
+{
+  size_t mapCount = zoneMaps.size() / MAP_NUMBERS;
+  for (size_t m = 0; m < mapCount; m++)
+  {
+    if (memcmp(&zoneMaps[m * MAP_NUMBERS], zoneOf, MAP_NUMBERS) == 0)
+      return m;
+  }
+  zoneMaps.insert(zoneMaps.end(), zoneOf, zoneOf + MAP_NUMBERS);
+  return mapCount;
+}
+
+// Function to turn the conditional outputs of one input number into a slot
+// Unconditional entries become a plain output run; entries with value ranges
+// are split into zones where the set of matching outputs is constant.
+// Returns false if the tables would outgrow their 16-bit indexes.
+inline bool assembleSlot(const std::vector<ConditionalOutput> &rules, RuntimeMapping &out, MapSlot &slot)
+{
+  size_t ruleCount = rules.size();
+
+  bool conditional = false;
+  for (size_t r = 0; r < ruleCount; r++)
+  {
+    if (rules[r].minValue > 0 || rules[r].maxValue < 127)
+      conditional = true;
+  }
+
+  if (!conditional)
+  {
+    if (out.outputs.size() + ruleCount > 0xFFFF)
+      return false;
+    slot = {(uint16_t)out.outputs.size(), (uint16_t)ruleCount, 0, SLOT_PLAIN};
+    for (size_t r = 0; r < ruleCount; r++)
+      out.outputs.push_back(rules[r].out);
+    return true;
+  }
+
+  uint8_t zoneOf[MAP_NUMBERS];
+  size_t firstZone = out.zones.size();
+  int zoneCount = 0;
+
+  for (int v = 0; v < MAP_NUMBERS; v++)
+  {
+    // A new zone starts wherever any rule starts or stops matching
+    bool newZone = (v == 0);
+    for (size_t r = 0; r < ruleCount && !newZone; r++)
+    {
+      if (coversValue(rules[r], v) != coversValue(rules[r], v - 1))
+        newZone = true;
+    }
+
+    if (newZone)
+    {
+      if (out.outputs.size() + ruleCount > 0xFFFF || out.zones.size() >= 0xFFFF)
+        return false;
+
+      OutputSpan span = {(uint16_t)out.outputs.size(), 0, 0};
+      for (size_t r = 0; r < ruleCount; r++)
+      {
+        if (coversValue(rules[r], v))
+        {
+          out.outputs.push_back(rules[r].out);
+          span.count++;
+        }
+      }
+      span.mapped = span.count > 0; // No matching rule: pass through
+      out.zones.push_back(span);
+      zoneCount++;
+    }
+    zoneOf[v] = zoneCount - 1;
+  }
+
+  if (out.zoneMaps.size() / MAP_NUMBERS >= 0xFFFF)
+    return false;
+  slot = {(uint16_t)firstZone, (uint16_t)zoneCount, addZoneMap(out.zoneMaps, zoneOf), SLOT_ZONED};
+  return true;
+}
+
+// Function to parse a range key such as "36-59"
+// Returns false for anything else (including plain numbers)
+inline bool parseKeyRange(const char *key, uint8_t &lo, uint8_t &hi)
+{
+  int a = 0, b = 0, digitsA = 0, digitsB = 0;
+  const char *p = key;
+  while (*p >= '0' && *p <= '9' && digitsA < 4)
+    a = a * 10 + (*p++ - '0'), digitsA++;
+  if (digitsA == 0 || *p++ != '-')
+    return false;
+  while (*p >= '0' && *p <= '9' && digitsB < 4)
+    b = b * 10 + (*p++ - '0'), digitsB++;
+  if (digitsB == 0 || *p != '\0' || a > b || b > 127)
+    return false;
+  lo = a;
+  hi = b;
+  return true;
+}
+
+// Range key entry of a map
+struct RangeEntry
+{
+  uint8_t lo;
+  uint8_t hi;
+  JsonVariant mapping;
+};
+
+// Function to parse a plain number key the way the compiler looks it up ("7", not "007")
+// Returns the number, or -1 for anything else
+inline int parseExactKey(const char *key)
+{
+  int n = 0, digits = 0;
+  for (const char *p = key; *p; p++)
+  {
+    if (*p < '0' || *p > '9' || ++digits > 3 || (digits == 2 && n == 0))
+      return -1;
+    n = n * 10 + (*p - '0');
+  }
+  return (digits == 0 || n > 127) ? -1 : n;
+}
+
+// Function to check if a map has the plain key of an input number
+inline bool hasExactKey(const RuntimeMapping &m, MidiMessageType type, uint8_t n)
+{
+  return m.exactKeys[type][n / 32] & (1UL << (n % 32));
+}
+
+// Function to record a key added to or removed from a map
+inline void indexKey(RuntimeMapping &m, MidiMessageType type, const char *key, bool present)
+{
+  RangeKey range;
+  if (parseKeyRange(key, range.lo, range.hi))
+  {
+    std::vector<RangeKey> &keys = m.rangeKeys[type];
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+      if (strcmp(keys[i].key, key) == 0)
+      {
+        if (!present)
+          keys.erase(keys.begin() + i);
+        return;
+      }
+    }
+    if (present)
+    {
+      strncpy(range.key, key, sizeof(range.key));
+      keys.push_back(range);
+    }
+    return;
+  }
+
+  int n = parseExactKey(key);
+  if (n < 0)
+    return;
+  if (present)
+    m.exactKeys[type][n / 32] |= 1UL << (n % 32);
+  else
+    m.exactKeys[type][n / 32] &= ~(1UL << (n % 32));
+}
+
+// Function to index the keys of a map and collect its range keys ("36-59")
+inline void indexKeys(JsonObject map, MidiMessageType type, RuntimeMapping &out, std::vector<RangeEntry> &ranges)
+{
+  ranges.clear();
+  for (JsonPair kv : map)
+  {
+    const char *key = kv.key().c_str();
+    indexKey(out, type, key, true);
+
+    RangeEntry range;
+    if (parseKeyRange(key, range.lo, range.hi))
+    {
+      range.mapping = kv.value();
+      ranges.push_back(range);
+    }
+  }
+}
+
+// Function to read the note off delay given to notes created from CC/PC inputs
+inline uint16_t readNoteGate(JsonDocument &doc, MidiMessageType type)
+{
+  if (type == MSG_NOTE)
+    return 0; // Note inputs have their own note off
+  int noteGateMs = doc["note_gate"] | 0;
+  return constrain(noteGateMs, 0, 65535);
+}
+
+// Function to compile the slot of one input number
+// An exact key wins; otherwise all covering ranges are combined in order.
+// ranges must hold every range key covering n; the key index must be current.
+// Returns false if the mapping is too large for the tables
+inline bool compileNumber(JsonObject map, MidiMessageType type, uint8_t n, uint16_t autoGate,
+                          const std::vector<RangeEntry> &ranges, std::vector<ConditionalOutput> &rules, RuntimeMapping &out)
+{
+  MapSlot &slot = out.slots[slotIndex(type, n)];
+  rules.clear();
+
+  if (hasExactKey(out, type, n))
+  {
+    compileEntry(map[String(n)], type, n, autoGate, rules, out.rejectedOutputs);
+  }
+  else
+  {
+    bool covered = false;
+    for (const RangeEntry &range : ranges)
+    {
+      if (n >= range.lo && n <= range.hi)
+      {
+        covered = true;
+        compileEntry(range.mapping, type, n, autoGate, rules, out.rejectedOutputs);
+      }
+    }
+    if (!covered)
+    {
+      slot = {0, 0, 0, SLOT_UNMAPPED};
+      return true;
+    }
+  }
+
+  return assembleSlot(rules, out, slot);
+}
+
+// Function to compile a mapping document into lookup tables
+// Outputs with a number outside 0-127 are skipped; out.rejectedOutputs
+// counts them. Returns false if the mapping is too large for the tables
+inline bool compileMapping(JsonDocument &doc, RuntimeMapping &out)
+{
+  out.outputs.clear();
+  out.zones.clear();
+  out.zoneMaps.clear();
+  out.staleOutputs = 0;
+  out.staleZones = 0;
+  out.rejectedOutputs = 0;
+  memset(out.exactKeys, 0, sizeof(out.exactKeys));
+  for (std::vector<RangeKey> &keys : out.rangeKeys)
+    keys.clear();
+  for (MapSlot &slot : out.slots)
+    slot = {0, 0, 0, SLOT_UNMAPPED};
+
+  std::vector<ConditionalOutput> rules;
+  std::vector<RangeEntry> ranges;
+
+  for (int t = 0; t < MAP_TYPES; t++)
+  {
+    MidiMessageType type = (MidiMessageType)t;
+    String mapKey = getMappingKey(type);
+    if (!doc.containsKey(mapKey))
+      continue;
+
+    JsonObject map = doc[mapKey];
+    uint16_t autoGate = readNoteGate(doc, type);
+    indexKeys(map, type, out, ranges);
+
+    for (int n = 0; n < MAP_NUMBERS; n++)
+    {
+      if (!compileNumber(map, type, n, autoGate, ranges, rules, out))
+        return false;
+    }
+  }
+  return true;
+}
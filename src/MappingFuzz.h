@@ -0,0 +1,97 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <memory>
+#include <vector>
+#include "MappingCompiler.h"
+#include "MappingCheck.h"
+#include "DefaultMapping.h"
+
+// Differential fuzzing of the compiled mapping engine ('fuzz')
+//
+// Generates random mapping documents in the original format, including the
+// odd corners (strings without a colon, unknown type prefixes, numbers past
+// 127, floats, nulls, long arrays), compiles them, feeds random MIDI byte
+// streams through the parser and maps every message with both the compiled
+// tables and the reference interpreter. Any difference in what would go on
+// the wire is reported with the document and input that caused it. The
+// generators and the comparison live in MappingCheck.h.
+//
+// The compiled tables live on the heap only while the fuzzer runs.
+
+const int FUZZ_MAX_REPORTS = 3;     // Divergences printed in full
+
+// Function to print one output list of a divergence report
+inline void printFuzzOutputs(const char *label, const MappedOutput *outs, int count, bool mapped)
+{
+  static const char *const TYPE_NAMES[] = {"cc", "pc", "note"};
+  Serial.printf("  %-9s: %s", label, mapped ? "mapped" : "thru");
+  for (int i = 0; i < count; i++)
+    Serial.printf(" %s:%u/%u", TYPE_NAMES[outs[i].type], outs[i].number, outs[i].value);
+  Serial.println();
+}
+
+// Function to print a divergence report
+inline void printFuzzReport(JsonDocument &doc, const MidiData &midi, const MappedOutput *reference, int referenceCount,
+                            bool referenceMapped, const std::vector<MappedOutput> &compiled, bool compiledMapped, bool same)
+{
+  static const char *const TYPE_NAMES[] = {"cc", "pc", "note"};
+  Serial.printf("%s on %s %u value %u\n", same ? "• Target outside 0-127 (rejected)" : "✗ Divergence",
+                TYPE_NAMES[midi.type], midi.inNumber, midi.inValue);
+  Serial.print("  Mapping  : ");
+  serializeJson(doc, Serial);
+  Serial.println();
+  printFuzzOutputs("Reference", reference, referenceCount, referenceMapped);
+  printFuzzOutputs("Compiled", compiled.data(), compiled.size(), compiledMapped);
+}
+
+// Function to run the differential fuzzer
+// The seed makes a run repeatable: rerun a failure with the printed seed
+inline void runMappingFuzz(uint32_t docs, uint32_t seed)
+{
+  auto compiledHeap = std::make_unique<RuntimeMapping>();
+  RuntimeMapping &compiled = *compiledHeap;
+  JsonDocument doc;
+  std::vector<MappedOutput> outputs;
+  FuzzStats stats = {};
+  uint32_t rng = seed ? seed : 1;
+
+  uint32_t start = millis();
+  for (uint32_t d = 0; d < docs; d++)
+  {
+    fuzzDocument(doc, rng);
+    if (!compileMapping(doc, compiled))
+    {
+      stats.divergences++;
+      Serial.println("✗ Compile failed");
+      continue;
+    }
+    MappingTable table = compiled.table();
+    stats.docs++;
+
+    fuzzStream(doc, table, rng, outputs, stats,
+               [&](const MidiData &midi, const MappedOutput *reference, int referenceCount, bool referenceMapped,
+                   bool compiledMapped, bool same)
+               {
+                 if ((same ? stats.outOfRange : stats.divergences) <= FUZZ_MAX_REPORTS)
+                   printFuzzReport(doc, midi, reference, referenceCount, referenceMapped, outputs, compiledMapped, same);
+               });
+  }
+  uint32_t elapsed = millis() - start;
+  uint32_t defaultDiffs = checkDefaultMapping();
+
+  uint32_t errors = stats.divergences + defaultDiffs;
+  Serial.printf("\n=== Mapping Fuzz (seed %lu) ===\n", (unsigned long)seed);
+  Serial.printf("Documents      : %lu\n", (unsigned long)stats.docs);
+  Serial.printf("Inputs         : %lu (%lu mapped by the reference)\n", (unsigned long)stats.inputs, (unsigned long)stats.mapped);
+  Serial.printf("Outputs        : %lu compared\n", (unsigned long)stats.outputs);
+  Serial.printf("Capped arrays  : %lu (reference stops at 10 outputs, intended)\n", (unsigned long)stats.capped);
+  Serial.printf("Out of range   : %lu inputs with targets outside 0-127 (rejected by the compiler)\n",
+                (unsigned long)stats.outOfRange);
+  Serial.printf("Divergences    : %lu\n", (unsigned long)stats.divergences);
+  Serial.printf("Default JSON   : %lu inputs differ from the flash tables\n", (unsigned long)defaultDiffs);
+  Serial.printf("Time           : %lu ms\n", (unsigned long)elapsed);
+  Serial.printf("Result         : %s\n", errors ? "✗ FAIL" : "✓ PASS");
+  Serial.println("==============================\n");
+}
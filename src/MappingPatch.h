@@ -0,0 +1,195 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "MappingCompiler.h"
+
+// Incremental mapping patches
+//
+// The config UI edits one map entry at a time. A patch changes that entry in
+// the mapping document and recompiles only the slots it covers, appending
+// their new outputs to the arena. The runs they replace become stale and are
+// reclaimed by a full recompile once they outweigh the live tables.
+//
+// Patch (MessagePack map):
+//   {"op": "set" | "del" | "rep", "map": "cc_map", "key": 12 | "12" | "36-59", "val": <entry>}
+// "set" adds or overwrites an entry, "rep" only overwrites an existing one,
+// "del" removes it. <entry> is anything a JSON mapping entry can be.
+
+enum PatchResult : uint8_t
+{
+  PATCH_OK,
+  PATCH_BAD_REQUEST, // Unknown op or map, bad key, missing value, output number outside 0-127
+  PATCH_NOT_FOUND,   // "del"/"rep" of a key that does not exist
+  PATCH_TOO_LARGE,   // Entry does not fit in the tables (patch not applied)
+  PATCH_NO_MEMORY,   // No mapping to patch: the built-in one could not be loaded
+};
+
+const char *const PATCH_RESULT_NAMES[] = {"ok", "bad request", "not found", "too large", "no memory"};
+
+// Stale arena entries below this are never worth a full recompile
+const uint32_t PATCH_COMPACT_MIN = 256;
+
+// Input numbers whose slots a patch recompiled
+struct PatchedRange
+{
+  MidiMessageType type;
+  uint8_t lo;
+  uint8_t hi;
+};
+
+// Function to find the input type of a map name ("cc_map", "pc_map", "note_map")
+inline bool parseMapName(const String &name, MidiMessageType &type)
+{
+  for (int t = 0; t < MAP_TYPES; t++)
+  {
+    if (name == getMappingKey((MidiMessageType)t))
+    {
+      type = (MidiMessageType)t;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Function to parse a patch key: a number (12 or "12") or a range ("36-59")
+// The key is normalised to the form the compiler looks up
+inline bool parsePatchKey(JsonVariant key, String &name, uint8_t &lo, uint8_t &hi)
+{
+  if (key.is<int>())
+  {
+    int n = key.as<int>();
+    if (n < 0 || n > 127)
+      return false;
+    lo = hi = n;
+    name = String(n);
+    return true;
+  }
+
+  if (!key.is<const char *>())
+    return false;
+
+  const char *text = key.as<const char *>();
+  if (parseKeyRange(text, lo, hi))
+  {
+    name = text;
+    return true;
+  }
+
+  // Plain number in a string
+  int n = 0, digits = 0;
+  for (const char *p = text; *p; p++)
+  {
+    if (*p < '0' || *p > '9' || ++digits > 3)
+      return false;
+    n = n * 10 + (*p - '0');
+  }
+  if (digits == 0 || n > 127)
+    return false;
+  lo = hi = n;
+  name = String(n);
+  return true;
+}
+
+// Function to mark the arena entries of a slot as stale
+inline void retireSlot(RuntimeMapping &m, const MapSlot &slot)
+{
+  if (slot.kind == SLOT_PLAIN)
+  {
+    m.staleOutputs += slot.count;
+  }
+  else if (slot.kind == SLOT_ZONED)
+  {
+    m.staleZones += slot.count;
+    for (int z = 0; z < slot.count; z++)
+      m.staleOutputs += m.zones[slot.first + z].count;
+  }
+}
+
+// Function to recompile the slots of a range of input numbers
+// Uses the key index instead of walking the map: only the range keys that
+// overlap the patched numbers are looked up, once each.
+// Returns false if they do not fit in the tables
+inline bool recompileNumbers(JsonDocument &doc, RuntimeMapping &m, const PatchedRange &range)
+{
+  JsonObject map = doc[getMappingKey(range.type)];
+  uint16_t autoGate = readNoteGate(doc, range.type);
+
+  std::vector<RangeEntry> ranges;
+  std::vector<ConditionalOutput> rules;
+  for (const RangeKey &key : m.rangeKeys[range.type])
+  {
+    if (key.lo <= range.hi && key.hi >= range.lo)
+    {
+      JsonVariant mapping = map[key.key];
+      ranges.push_back({key.lo, key.hi, mapping});
+    }
+  }
+
+  for (int n = range.lo; n <= range.hi; n++)
+  {
+    // An exact key wins over ranges, so a range patch leaves its slot alone
+    if (range.lo != range.hi && hasExactKey(m, range.type, n))
+      continue;
+    retireSlot(m, m.slots[slotIndex(range.type, n)]);
+    if (!compileNumber(map, range.type, n, autoGate, ranges, rules, m))
+      return false;
+  }
+  return true;
+}
+
+// Function to apply one patch to a mapping document and its compiled tables
+// On success `changed` tells which slots were rebuilt. The tables may have
+// moved in memory: take a fresh m.table() afterwards.
+inline PatchResult applyPatch(JsonDocument &doc, RuntimeMapping &m, JsonVariant patch, PatchedRange &changed)
+{
+  String op = patch["op"] | "";
+  bool remove = (op == "del");
+  if (!remove && op != "set" && op != "rep")
+    return PATCH_BAD_REQUEST;
+
+  String mapName = patch["map"] | "";
+  String key;
+  if (!parseMapName(mapName, changed.type) || !parsePatchKey(patch["key"], key, changed.lo, changed.hi))
+    return PATCH_BAD_REQUEST;
+  if (!remove && !patch.containsKey("val"))
+    return PATCH_BAD_REQUEST;
+
+  bool exists = doc[mapName].is<JsonObject>() && doc[mapName].containsKey(key);
+  if ((remove || op == "rep") && !exists)
+    return PATCH_NOT_FOUND;
+
+  // Keep the old entry so a patch that does not fit can be undone
+  JsonDocument previous;
+  if (exists)
+    previous.set(doc[mapName][key]);
+
+  if (!doc[mapName].is<JsonObject>())
+    doc[mapName].to<JsonObject>();
+  JsonObject map = doc[mapName];
+  if (remove)
+    map.remove(key);
+  else
+    map[key] = patch["val"];
+  indexKey(m, changed.type, key.c_str(), !remove);
+
+  m.rejectedOutputs = 0;
+  bool fits = recompileNumbers(doc, m, changed);
+  bool rejected = m.rejectedOutputs > 0;
+  if (fits && !rejected)
+  {
+    // Reclaim stale runs once they outweigh the live tables
+    bool compact = (m.staleOutputs > PATCH_COMPACT_MIN && m.staleOutputs * 2 > m.outputs.size()) ||
+                   (m.staleZones > PATCH_COMPACT_MIN && m.staleZones * 2 > m.zones.size());
+    if (!compact || compileMapping(doc, m))
+      return PATCH_OK;
+  }
+
+  // Out of table space or a bad output number: restore the entry and rebuild without garbage
+  if (exists)
+    map[key] = previous.as<JsonVariant>();
+  else
+    map.remove(key);
+  compileMapping(doc, m);
+  return (fits && rejected) ? PATCH_BAD_REQUEST : PATCH_TOO_LARGE;
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "MidiTypes.h"
+
+// Compiled mapping tables
+//
+// A mapping is stored as one slot per (message type, input number) pair.
+// Each slot points at a contiguous run of outputs in a shared output arena,
+// so looking up a mapping is a single array index instead of a JSON walk.
+//
+// Slots with value conditions (velocity layers, CC zones) are "zoned": a
+// 128-entry zone map turns the input value into a zone index, and each zone
+// has its own output run. Evaluation is two table reads, no matter how many
+// rules the entry had.
+
+// Table dimensions: CC, PC and Note inputs, numbers 0-127
+constexpr int MAP_TYPES = 3;
+constexpr int MAP_NUMBERS = 128;
+constexpr int MAP_SLOTS = MAP_TYPES * MAP_NUMBERS;
+
+// One output of a compiled mapping entry
+// Packed to 16 bytes: wide fan-outs are long runs of these in the arena
+struct CompiledOutput
+{
+  float scale;         // Value scale factor (1.0 = unchanged)
+  uint16_t delayMs;    // Output delay
+  uint16_t gateMs;     // Automatic note off for note outputs (0 = none)
+  uint16_t intervalMs; // Time between copies
+  uint8_t type : 2;    // Output MidiMessageType
+  uint8_t repeat : 6;  // Extra copies (echo)
+  uint8_t number;      // Output CC/PC/Note number
+  uint8_t value;       // Fixed output value (VALUE_FROM_INPUT = scaled input value)
+  uint8_t sources;     // Bit mask of MidiSource inputs it reacts to (0 = any)
+  uint8_t deadband;    // CC redundancy suppression (THIN_OFF = off)
+  uint8_t minGapMs;    // CC rate limit (0 = none)
+};
+
+static_assert(sizeof(CompiledOutput) == 16, "CompiledOutput should stay packed");
+
+// Maximum echo copies per output
+constexpr int MAX_REPEATS = 16;
+
+// value of outputs that pass on the (scaled) input value
+const uint8_t VALUE_FROM_INPUT = 0xFF;
+
+// Velocity of note outputs of PC inputs. A PC has no value to pass on, and
+// velocity 0 would make every such note a note off.
+const uint8_t PC_NOTE_VELOCITY = 100;
+
+// Function to get the value an output gets when the mapping sets none
+constexpr uint8_t defaultOutputValue(MidiMessageType inType, MidiMessageType outType)
+{
+  return (inType == MSG_PC && outType == MSG_NOTE) ? PC_NOTE_VELOCITY : VALUE_FROM_INPUT;
+}
+
+// Slot kinds
+const uint8_t SLOT_UNMAPPED = 0; // No entry, pass the message through
+const uint8_t SLOT_PLAIN = 1;    // Same outputs for every value
+const uint8_t SLOT_ZONED = 2;    // Outputs depend on the value, see zoneMap
+
+// Lookup slot for one input number
+struct MapSlot
+{
+  uint16_t first;   // Plain: first output in the arena. Zoned: first zone span
+  uint16_t count;   // Plain: number of outputs. Zoned: number of zones
+  uint16_t zoneMap; // Zoned: index of the value -> zone map
+  uint8_t kind;     // SLOT_UNMAPPED, SLOT_PLAIN or SLOT_ZONED
+};
+
+// Run of outputs in the arena
+struct OutputSpan
+{
+  uint16_t first; // Index of the first output
+  uint16_t count; // Number of outputs
+  uint8_t mapped; // 0 = no rule matched, pass the message through
+};
+
+const uint8_t ZONE_NONE = 0xFF; // No held note zone
+
+// Read-only view of a compiled mapping, either in flash or in RAM
+struct MappingTable
+{
+  const MapSlot *slots;          // MAP_SLOTS entries, see slotIndex()
+  const CompiledOutput *outputs; // Output arena
+  const OutputSpan *zones;       // Zone spans of zoned slots
+  const uint8_t *zoneMaps;       // MAP_NUMBERS entries per zone map
+};
+
+// Function to get the slot index for an input message
+constexpr int slotIndex(MidiMessageType type, uint8_t number)
+{
+  return type * MAP_NUMBERS + (number & 0x7F);
+}
+
+// Function to find the outputs for an input message
+// heldZones (one entry per note, ZONE_NONE when idle) makes a note off reach
+// the same zone as its note on; pass nullptr for non-note input
+inline OutputSpan lookupOutputs(const MappingTable &map, MidiMessageType type, uint8_t number, uint8_t value, uint8_t *heldZones)
+{
+  const MapSlot &slot = map.slots[slotIndex(type, number)];
+  if (slot.kind != SLOT_ZONED)
+    return {slot.first, slot.count, (uint8_t)(slot.kind != SLOT_UNMAPPED)};
+
+  uint8_t zone = map.zoneMaps[slot.zoneMap * MAP_NUMBERS + (value & 0x7F)];
+  if (heldZones != nullptr)
+  {
+    uint8_t &held = heldZones[number & 0x7F];
+    if (value == 0)
+    {
+      if (held != ZONE_NONE)
+        zone = held;
+      held = ZONE_NONE;
+    }
+    else
+    {
+      held = zone;
+    }
+  }
+  return map.zones[slot.first + zone];
+}
+
+// Function to apply value scaling/transformation
+inline uint8_t scaleValue(uint8_t inputValue, float scale)
+{
+  int scaled = (int)(inputValue * scale);
+  if (scaled > 127)
+    scaled = 127;
+  if (scaled < 0)
+    scaled = 0;
+  return (uint8_t)scaled;
+}
+
+// Function to map one input message
+// Calls emit(const MappedOutput &) for every output, straight from the
+// arena: no caller buffer and no limit on the fan-out.
+// Returns true if mapping was applied, false if the message passed through.
+template <typename Emit>
+bool mapMessage(const MappingTable &map, const MidiData &midi, uint8_t *heldZones, Emit emit)
+{
+  OutputSpan span = lookupOutputs(map, midi.type, midi.inNumber, midi.inValue, heldZones);
+
+  int emitted = 0;
+  if (span.mapped)
+  {
+    const CompiledOutput *out = map.outputs + span.first;
+    const CompiledOutput *end = out + span.count;
+    uint8_t sourceBit = 1 << midi.source;
+    for (; out != end; out++)
+    {
+      if (out->sources != 0 && !(out->sources & sourceBit))
+        continue; // Output restricted to other sources
+
+      uint8_t value = (out->value == VALUE_FROM_INPUT) ? scaleValue(midi.inValue, out->scale) : out->value;
+      MappedOutput o = {(MidiMessageType)out->type, out->number, value,
+                        out->delayMs, out->gateMs, out->repeat, out->intervalMs, out->deadband, out->minGapMs};
+      emit(o);
+      emitted++;
+    }
+
+    // Entries whose outputs are all for other sources act as unmapped
+    if (emitted > 0 || span.count == 0)
+      return true;
+  }
+
+  // Pass-through: no mapping for this specific number or value
+  MappedOutput o = {midi.type, midi.inNumber, midi.inValue, 0, 0, 0, 0, THIN_OFF, 0};
+  emit(o);
+  return false;
+}
+
+// Function to compare two compiled outputs field by field
+inline bool sameOutput(const CompiledOutput &a, const CompiledOutput &b)
+{
+  return a.scale == b.scale && a.delayMs == b.delayMs && a.gateMs == b.gateMs && a.intervalMs == b.intervalMs &&
+         a.type == b.type && a.number == b.number && a.value == b.value && a.repeat == b.repeat && a.sources == b.sources &&
+         a.deadband == b.deadband && a.minGapMs == b.minGapMs;
+}
+
+// Function to check that two mappings give the same outputs for every input
+// Returns the number of (type, number, value) inputs that differ
+inline uint32_t compareMappings(const MappingTable &a, const MappingTable &b)
+{
+  uint32_t diffs = 0;
+  for (int t = 0; t < MAP_TYPES; t++)
+  {
+    for (int n = 0; n < MAP_NUMBERS; n++)
+    {
+      for (int v = 0; v < MAP_NUMBERS; v++)
+      {
+        OutputSpan sa = lookupOutputs(a, (MidiMessageType)t, n, v, nullptr);
+        OutputSpan sb = lookupOutputs(b, (MidiMessageType)t, n, v, nullptr);
+        bool same = sa.mapped == sb.mapped && (!sa.mapped || sa.count == sb.count);
+        for (int i = 0; same && sa.mapped && i < sa.count; i++)
+          same = sameOutput(a.outputs[sa.first + i], b.outputs[sb.first + i]);
+        if (!same)
+          diffs++;
+      }
+    }
+  }
+  return diffs;
+}
+
+// Range key ("36-59") of a compiled map
+struct RangeKey
+{
+  uint8_t lo;
+  uint8_t hi;
+  char key[10]; // As written, at most "0000-0127"
+};
+
+// Mapping compiled at runtime from a JSON document (lives in RAM)
+struct RuntimeMapping
+{
+  MapSlot slots[MAP_SLOTS] = {};
+  std::vector<CompiledOutput> outputs;
+  std::vector<OutputSpan> zones;
+  std::vector<uint8_t> zoneMaps;
+  uint32_t staleOutputs = 0; // Arena entries no slot points at any more (patches)
+  uint32_t staleZones = 0;
+  uint32_t rejectedOutputs = 0; // Outputs skipped for a number outside 0-127 (last compile or patch)
+
+  // Keys of the compiled document, so a patch need not walk its map
+  uint32_t exactKeys[MAP_TYPES][MAP_NUMBERS / 32] = {}; // Bit n: the map has the key "n"
+  std::vector<RangeKey> rangeKeys[MAP_TYPES];           // In document order
+
+  MappingTable table() const { return {slots, outputs.data(), zones.data(), zoneMaps.data()}; }
+};
+
+// ---------------------------------------------------------------------------
+// Compile-time mapping builder
+//
+// Built-in mappings are written as a flat list of rules and turned into the
+// final slot/output tables by the compiler, so they end up in flash as
+// ready-to-use data. Rules for the same input must be listed together.
+
+// One compile-time rule: input message -> output message
+struct MapRule
+{
+  MidiMessageType inType;
+  uint8_t inNumber;
+  MidiMessageType outType;
+  uint8_t outNumber;
+  float scale;
+  uint16_t gateMs;
+};
+
+// Helper to write a rule; scale and note gate are optional
+constexpr MapRule mapRule(MidiMessageType inType, uint8_t inNumber, MidiMessageType outType, uint8_t outNumber, float scale = 1.0f, uint16_t gateMs = 0)
+{
+  return {inType, inNumber, outType, outNumber, scale, gateMs};
+}
+
+// Mapping tables with a fixed number of outputs, built by buildMapping()
+template <size_t N>
+struct StaticMapping
+{
+  MapSlot slots[MAP_SLOTS] = {};
+  CompiledOutput outputs[N] = {};
+
+  constexpr MappingTable table() const { return {slots, outputs, nullptr, nullptr}; }
+};
+
+// Check that all rules for one input are adjacent in the list
+template <size_t N>
+constexpr bool rulesGrouped(const MapRule (&rules)[N])
+{
+  for (size_t i = 1; i < N; i++)
+  {
+    bool sameAsPrev = rules[i].inType == rules[i - 1].inType && rules[i].inNumber == rules[i - 1].inNumber;
+    if (sameAsPrev)
+      continue;
+    for (size_t j = 0; j + 1 < i; j++)
+    {
+      if (rules[j].inType == rules[i].inType && rules[j].inNumber == rules[i].inNumber)
+        return false;
+    }
+  }
+  return true;
+}
+
+// Function to build mapping tables from a rule list at compile time
+template <size_t N>
+constexpr StaticMapping<N> buildMapping(const MapRule (&rules)[N])
+{
+  StaticMapping<N> m{};
+  for (size_t i = 0; i < N; i++)
+  {
+    MapSlot &slot = m.slots[slotIndex(rules[i].inType, rules[i].inNumber)];
+    if (slot.count == 0)
+      slot.first = i;
+    slot.count++;
+    slot.kind = SLOT_PLAIN;
+    m.outputs[i] = {rules[i].scale, 0, rules[i].gateMs, 0, (uint8_t)rules[i].outType, 0, rules[i].outNumber,
+                    defaultOutputValue(rules[i].inType, rules[i].outType), 0, THIN_OFF, 0};
+  }
+  return m;
+}
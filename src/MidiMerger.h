@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include "MidiTypes.h"
+#include "MidiParser.h"
+
+// Multi-source MIDI merger
+//
+// Every input source has its own parser (with its own running status and
+// partial message) and its own event queue, so bytes from one source can
+// never complete or corrupt a message from another. pop() hands out the
+// queued events of all sources in timestamp order.
+//
+// SysEx is parsed byte by byte, so a status byte from another source would
+// end it at the receiver. While one source is inside a SysEx, the events of
+// the other sources wait (real-time bytes excepted, they may appear inside a
+// SysEx) until its F7 or until it stays silent for MERGER_SYSEX_HOLD_US. A
+// long SysEx dump therefore holds the other inputs back, and their queues
+// may fill and drop.
+
+// One complete message from one source
+struct MidiEvent
+{
+  uint32_t timeUs;    // micros() when the message was completed (generated: when it was due)
+  MidiMessage msg;
+  MidiSource source;
+};
+
+const uint8_t MERGER_QUEUE_SIZE = 64;         // Events per source (power of two)
+const uint32_t MERGER_SYSEX_HOLD_US = 50000;  // Silence that ends holding for an open SysEx
+
+class MidiMerger
+{
+public:
+  // Function to feed one raw byte received from a source
+  // Returns false if a completed message had to be dropped
+  bool feed(MidiSource source, uint8_t b, uint32_t timeUs)
+  {
+    MidiMessage msg;
+    if (!parsers[source].feed(b, msg))
+      return true;
+    return push(source, msg, timeUs);
+  }
+
+  // Function to queue an already complete message from a source
+  // Returns false if the source queue is full
+  bool push(MidiSource source, const MidiMessage &msg, uint32_t timeUs)
+  {
+    Queue &q = queues[source];
+    if ((uint8_t)(q.tail - q.head) >= MERGER_QUEUE_SIZE)
+    {
+      q.dropped++;
+      return false;
+    }
+    q.events[q.tail & (MERGER_QUEUE_SIZE - 1)] = {timeUs, msg, source};
+    q.tail++;
+    q.received++;
+    return true;
+  }
+
+  // Function to check that a source can take at least one more message
+  bool hasSpace(MidiSource source) const
+  {
+    return (uint8_t)(queues[source].tail - queues[source].head) < MERGER_QUEUE_SIZE;
+  }
+
+  // Function to take the oldest queued event over all sources
+  // Events held back by another source's open SysEx are skipped
+  // Returns false when no event can be taken
+  bool pop(MidiEvent &ev, uint32_t nowUs)
+  {
+    if (sysexSource >= 0 && queues[sysexSource].head == queues[sysexSource].tail &&
+        nowUs - sysexLastUs >= MERGER_SYSEX_HOLD_US)
+    {
+      sysexSource = -1; // The sender went quiet: stop holding the others
+      sysexTimeoutCount++;
+    }
+
+    int best = -1;
+    for (int s = 0; s < SRC_COUNT; s++)
+    {
+      Queue &q = queues[s];
+      if (q.head == q.tail)
+        continue;
+      if (sysexSource >= 0 && s != sysexSource && front(q).msg.bytes[0] < 0xF8)
+        continue; // Would end the open SysEx
+      if (best < 0 || (int32_t)(front(q).timeUs - front(queues[best]).timeUs) < 0)
+        best = s;
+    }
+    if (best < 0)
+      return false;
+
+    Queue &q = queues[best];
+    ev = front(q);
+    q.head++;
+    trackSysEx(ev);
+    return true;
+  }
+
+  // Function to drop all queued events and partial messages
+  void reset()
+  {
+    for (int s = 0; s < SRC_COUNT; s++)
+    {
+      parsers[s].reset();
+      queues[s].head = queues[s].tail = 0;
+      queues[s].received = queues[s].dropped = 0;
+    }
+    sysexSource = -1;
+    sysexTimeoutCount = 0;
+  }
+
+  uint32_t received(MidiSource source) const { return queues[source].received; }
+  uint32_t dropped(MidiSource source) const { return queues[source].dropped; }
+  uint32_t sysexTimeouts() const { return sysexTimeoutCount; }
+
+private:
+  struct Queue
+  {
+    MidiEvent events[MERGER_QUEUE_SIZE];
+    uint8_t head = 0; // Next event to pop
+    uint8_t tail = 0; // Next free entry
+    uint32_t received = 0;
+    uint32_t dropped = 0;
+  };
+
+  static const MidiEvent &front(const Queue &q)
+  {
+    return q.events[q.head & (MERGER_QUEUE_SIZE - 1)];
+  }
+
+  // Function to follow the SysEx state of the source an event came from
+  void trackSysEx(const MidiEvent &ev)
+  {
+    uint8_t b = ev.msg.bytes[0];
+    if (b >= 0xF8)
+      return; // Real-time bytes do not end a SysEx
+    if (b == 0xF0)
+    {
+      sysexSource = ev.source;
+      sysexLastUs = ev.timeUs;
+    }
+    else if (ev.source == sysexSource)
+    {
+      sysexLastUs = ev.timeUs;
+      if (b & 0x80)
+        sysexSource = -1; // F7 or any other status byte ends it
+    }
+  }
+
+  MidiParser parsers[SRC_COUNT];
+  Queue queues[SRC_COUNT];
+  int8_t sysexSource = -1; // Source inside a SysEx, -1 = none
+  uint32_t sysexLastUs = 0; // Time of its last SysEx byte
+  uint32_t sysexTimeoutCount = 0;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+#include "MidiTypes.h"
+
+// Complete MIDI message assembled by MidiParser
+struct MidiMessage
+{
+  uint8_t bytes[3]; // Status byte followed by data bytes
+  uint8_t length;   // Number of valid bytes (1-3)
+};
+
+// Streaming MIDI byte parser with running status
+//
+// Feed it raw bytes from a serial port; it reports a message every time one
+// is complete. Real-time bytes (0xF8-0xFF) are reported immediately without
+// disturbing a message in progress. SysEx bytes are reported one at a time
+// so they can be forwarded untouched.
+class MidiParser
+{
+public:
+  // Function to feed one byte
+  // Returns true when msg holds a complete message
+  bool feed(uint8_t b, MidiMessage &msg)
+  {
+    if (b >= 0xF8)
+    {
+      // Real-time: may appear anywhere, even inside other messages
+      msg = {{b, 0, 0}, 1};
+      return true;
+    }
+
+    if (b & 0x80)
+    {
+      inSysEx = (b == 0xF0);
+      count = 0;
+
+      if (b >= 0xF0)
+      {
+        // System common and SysEx cancel running status
+        status = 0;
+        expected = systemDataLength(b);
+        if (expected == 0)
+        {
+          msg = {{b, 0, 0}, 1};
+          return true;
+        }
+        status = b;
+        return false;
+      }
+
+      status = b;
+      expected = ((b & 0xF0) == 0xC0 || (b & 0xF0) == 0xD0) ? 1 : 2;
+      return false;
+    }
+
+    // Data byte
+    if (inSysEx)
+    {
+      msg = {{b, 0, 0}, 1};
+      return true;
+    }
+
+    if (status == 0)
+      return false; // Stray data byte without status, drop it
+
+    data[count++] = b;
+    if (count < expected)
+      return false;
+
+    msg = {{status, data[0], data[1]}, (uint8_t)(1 + expected)};
+    count = 0;
+    if (status >= 0xF0)
+      status = 0; // System common messages have no running status
+    return true;
+  }
+
+  // Function to drop any partial message and running status
+  void reset()
+  {
+    status = 0;
+    count = 0;
+    inSysEx = false;
+  }
+
+private:
+  // Function to get the data length of a system common/exclusive status byte
+  static uint8_t systemDataLength(uint8_t b)
+  {
+    switch (b)
+    {
+    case 0xF1: // MTC quarter frame
+    case 0xF3: // Song select
+      return 1;
+    case 0xF2: // Song position
+      return 2;
+    default: // SysEx start/end, tune request, undefined
+      return 0;
+    }
+  }
+
+  uint8_t status = 0; // Running status (0 = none)
+  uint8_t data[2] = {0, 0};
+  uint8_t count = 0;
+  uint8_t expected = 0;
+  bool inSysEx = false;
+};
+
+// Function to turn a complete message into mapper input
+// CC, PC, note on and note off (as velocity 0) are mappable; returns false
+// for everything else (real-time, SysEx, pitch bend, aftertouch, ...)
+inline bool decodeMidiMessage(const MidiMessage &msg, MidiSource source, MidiData &midi)
+{
+  midi = {MSG_CC, 0, 0, 0, 0, source};
+  switch (msg.bytes[0] & 0xF0)
+  {
+  case 0xB0:
+    midi.type = MSG_CC;
+    midi.inNumber = msg.bytes[1];
+    midi.inValue = msg.bytes[2];
+    return true;
+  case 0xC0:
+    midi.type = MSG_PC;
+    midi.inNumber = msg.bytes[1];
+    return true;
+  case 0x90:
+    midi.type = MSG_NOTE;
+    midi.inNumber = msg.bytes[1];
+    midi.inValue = msg.bytes[2];
+    return true;
+  case 0x80:
+    midi.type = MSG_NOTE; // Note off = note with velocity 0
+    midi.inNumber = msg.bytes[1];
+    return true;
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+// MIDI message types
+enum MidiMessageType
+{
+  MSG_CC = 0,  // Control Change
+  MSG_PC = 1,  // Program Change
+  MSG_NOTE = 2 // Note
+};
+
+// MIDI input sources
+enum MidiSource : uint8_t
+{
+  SRC_DIN = 0, // 5-pin DIN on Serial1
+  SRC_USB = 1, // Host over USB serial
+  SRC_GEN = 2, // Load generator ('load', demo mode)
+  SRC_COUNT
+};
+
+// Current MIDI data
+struct MidiData
+{
+  MidiMessageType type;
+  uint8_t inNumber;  // CC number, PC number, or Note number
+  uint8_t inValue;   // CC value, or Note velocity
+  uint8_t outNumber; // Mapped CC/PC/Note number
+  uint8_t outValue;  // Mapped value
+  MidiSource source; // Where the input came from
+};
+
+// Output structure for multiple mappings
+struct MappedOutput
+{
+  MidiMessageType type; // Output message type (can be different from input)
+  uint8_t number;
+  uint8_t value;
+  uint16_t delayMs;    // Send this long after the input (0 = immediately)
+  uint16_t gateMs;     // Note outputs: automatic note off after this long (0 = none)
+  uint8_t repeat;      // Extra copies sent after the first one
+  uint16_t intervalMs; // Time between repeats
+  uint8_t deadband;    // CC outputs: drop changes up to this size (THIN_OFF = send all)
+  uint8_t minGapMs;    // CC outputs: minimum time between updates (0 = no limit)
+};
+
+// deadband value of outputs without redundancy suppression
+const uint8_t THIN_OFF = 0xFF;
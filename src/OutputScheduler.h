@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "MidiTypes.h"
+#include "TimerWheel.h"
+
+// Mapped output scheduling
+//
+// Turns a mapped output into MIDI bytes and sends them now or puts them on
+// the timer wheel: delayed outputs, echoes and automatic note offs ("gate").
+//
+// Automatic note offs are tagged with the note on they belong to. A newer
+// note on of the same channel and note (a retrigger, or an echo faster than
+// the gate) makes the older pending note offs stale, so they cannot cut the
+// new note short. Only the last note off of an overlapping run is sent.
+
+// Note on tags per (channel, note)
+class NoteGenerations
+{
+public:
+  NoteGenerations()
+  {
+    clear();
+  }
+
+  // Function to forget all sounding notes
+  void clear()
+  {
+    memset(current, 0, sizeof(current));
+    counter = 0;
+  }
+
+  // Function to take a tag for a note on and its automatic note off
+  uint8_t take()
+  {
+    if (++counter == 0)
+      counter = 1; // 0 means untagged
+    return counter;
+  }
+
+  // Function to record a message going out on the wire
+  // A note on makes its tag (or a fresh one when untagged) the current one
+  void sent(const uint8_t *bytes, uint8_t length, uint8_t tag)
+  {
+    if (length == 3 && (bytes[0] & 0xF0) == 0x90 && bytes[2] > 0)
+      current[bytes[0] & 0x0F][bytes[1] & 0x7F] = tag ? tag : take();
+  }
+
+  // Function to check if a tagged note off belongs to a note struck again since
+  bool stale(const uint8_t *bytes, uint8_t length, uint8_t tag) const
+  {
+    uint8_t status = bytes[0] & 0xF0;
+    bool noteOff = length == 3 && (status == 0x80 || (status == 0x90 && bytes[2] == 0));
+    return tag != 0 && noteOff && current[bytes[0] & 0x0F][bytes[1] & 0x7F] != tag;
+  }
+
+private:
+  uint8_t current[16][128]; // Tag of the last note on sent, per channel and note
+  uint8_t counter;
+};
+
+// Function to encode one mapped output on the given channel
+// Returns the message length in bytes
+inline uint8_t encodeMidiOutput(const MappedOutput &out, uint8_t channel, uint8_t bytes[3])
+{
+  switch (out.type)
+  {
+  case MSG_CC:
+    bytes[0] = 0xB0 | channel;
+    bytes[1] = out.number & 0x7F;
+    bytes[2] = out.value & 0x7F;
+    return 3;
+  case MSG_PC:
+    bytes[0] = 0xC0 | channel;
+    bytes[1] = out.number & 0x7F;
+    return 2;
+  case MSG_NOTE:
+  default:
+    bytes[0] = 0x90 | channel; // Velocity 0 = note off
+    bytes[1] = out.number & 0x7F;
+    bytes[2] = out.value & 0x7F;
+    return 3;
+  }
+}
+
+// Function to send one mapped output, scheduling delayed parts on the timer wheel
+// send(bytes, length, tag) writes a message now and must pass it to
+// gens.sent(); lost(bytes, length) is told about messages the full wheel
+// refused. Each copy of a gated note gets its own tag.
+// Returns the number of bytes sent or scheduled (not those lost)
+template <typename Send, typename Lost>
+uint16_t scheduleMidiOutput(const MappedOutput &out, uint8_t channel, uint32_t nowMs, TimerWheel &wheel,
+                            NoteGenerations &gens, Send send, Lost lost)
+{
+  uint8_t bytes[3];
+  uint8_t length = encodeMidiOutput(out, channel, bytes);
+  bool autoOff = out.type == MSG_NOTE && out.gateMs > 0 && bytes[2] > 0;
+  uint8_t noteOff[3] = {bytes[0], bytes[1], 0};
+  uint16_t total = 0;
+
+  for (int r = 0; r <= out.repeat; r++)
+  {
+    uint32_t at = out.delayMs + (uint32_t)r * out.intervalMs;
+    uint8_t tag = autoOff ? gens.take() : 0;
+    if (at == 0)
+    {
+      send(bytes, length, tag);
+      total += length;
+    }
+    else if (wheel.schedule(nowMs, at, bytes, length, tag))
+    {
+      total += length;
+    }
+    else
+    {
+      lost(bytes, length);
+    }
+
+    if (autoOff)
+    {
+      if (wheel.schedule(nowMs, at + out.gateMs, noteOff, 3, tag))
+        total += 3;
+      else
+        lost(noteOff, 3);
+    }
+  }
+  return total;
+}
+
+// Function to send the scheduled messages that are due
+// Stale automatic note offs are dropped instead of sent
+// Returns the number of note offs dropped
+template <typename Send>
+uint16_t fireDueOutputs(TimerWheel &wheel, NoteGenerations &gens, uint32_t nowMs, Send send)
+{
+  uint16_t stale = 0;
+  wheel.advance(nowMs, [&](const uint8_t *bytes, uint8_t length, uint8_t tag)
+                {
+                  if (gens.stale(bytes, length, tag))
+                    stale++;
+                  else
+                    send(bytes, length, tag); });
+  return stale;
+}
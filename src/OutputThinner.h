@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Redundancy suppression for CC outputs
+//
+// Remembers the last value sent to every (channel, controller) and drops
+// outputs that would not change it, changes within a deadband, and updates
+// faster than a minimum gap. A dropped value is kept as pending and sent
+// once the controller settles or its gap has passed, so the last value the
+// receiver sees always equals the last value mapped.
+//
+// Every CC written to the port must be reported with noteSent(), whether it
+// went through admit() or not (pass-through, other mappings, delayed
+// outputs). Otherwise the cache goes stale and a held value could be
+// flushed over a newer one.
+
+const int THIN_CONTROLLERS = 16 * 128;  // Channel x CC number
+const int THIN_PENDING_MAX = 32;        // Controllers waiting for a flush
+const uint16_t THIN_SETTLE_MS = 30;     // Quiet time before a deadband value is flushed
+const uint8_t THIN_NONE = 0x80;         // No value (MIDI data bytes are 0-127)
+
+class OutputThinner
+{
+public:
+  // Why an output was dropped
+  enum Reason : uint8_t
+  {
+    DROP_UNCHANGED,
+    DROP_DEADBAND,
+    DROP_RATE,
+    DROP_REASONS
+  };
+
+  OutputThinner() { reset(); }
+
+  // Function to forget all sent values and pending flushes
+  void reset()
+  {
+    memset(lastSent, THIN_NONE, sizeof(lastSent));
+    memset(sentMs, 0, sizeof(sentMs));
+    pendingCount = 0;
+  }
+
+  // Function to decide whether a CC output goes out now
+  // Returns false if it is dropped; the caller then sends nothing
+  bool admit(uint8_t channel, uint8_t number, uint8_t value, uint8_t deadband, uint8_t minGapMs, uint32_t nowMs)
+  {
+    uint16_t id = (channel & 0x0F) * 128 + (number & 0x7F);
+    uint8_t last = lastSent[id];
+
+    if (last == THIN_NONE)
+      return accept(id, value, nowMs);
+
+    if (value == last)
+    {
+      // Back at the value the receiver has: nothing left to flush
+      removePending(id);
+      drops[DROP_UNCHANGED]++;
+      return false;
+    }
+
+    // The ends of the range always pass the deadband, so full sweeps land exactly
+    int change = value > last ? value - last : last - value;
+    bool inBand = change <= deadband && value != 0 && value != 127;
+    bool tooSoon = minGapMs > 0 && nowMs - sentMs[id] < minGapMs;
+    if (!inBand && !tooSoon)
+      return accept(id, value, nowMs);
+
+    uint32_t due = tooSoon ? sentMs[id] + minGapMs : nowMs;
+    if (inBand && (int32_t)(due - nowMs) < THIN_SETTLE_MS)
+      due = nowMs + THIN_SETTLE_MS;
+    if (!setPending(id, value, due))
+      return accept(id, value, nowMs); // No room to remember it, send now
+
+    drops[inBand ? DROP_DEADBAND : DROP_RATE]++;
+    return false;
+  }
+
+  // Function to record a CC written to the port by any path
+  // A newer value on the wire replaces whatever was held back
+  void noteSent(uint8_t channel, uint8_t number, uint8_t value, uint32_t nowMs)
+  {
+    uint16_t id = (channel & 0x0F) * 128 + (number & 0x7F);
+    if (pendingCount > 0)
+      removePending(id);
+    lastSent[id] = value;
+    sentMs[id] = nowMs;
+  }
+
+  // Function to send pending values that are due
+  // Calls send(channel, number, value) for each; send may call noteSent()
+  template <typename Send>
+  void flush(uint32_t nowMs, Send send)
+  {
+    for (int i = 0; i < pendingCount;)
+    {
+      if ((int32_t)(nowMs - pending[i].dueMs) < 0)
+      {
+        i++;
+        continue;
+      }
+      Pending p = pending[i];
+      pending[i] = pending[--pendingCount];
+      lastSent[p.id] = p.value;
+      sentMs[p.id] = nowMs;
+      flushed++;
+      send(p.id / 128, p.id % 128, p.value);
+    }
+  }
+
+  uint32_t dropped(Reason reason) const { return drops[reason]; }
+  uint32_t flushes() const { return flushed; }
+  int pendingFlushes() const { return pendingCount; }
+
+  // Function to clear the counters
+  void resetStats()
+  {
+    memset(drops, 0, sizeof(drops));
+    flushed = 0;
+  }
+
+private:
+  struct Pending
+  {
+    uint32_t dueMs;
+    uint16_t id;
+    uint8_t value;
+  };
+
+  // Function to record a value that is sent now
+  bool accept(uint16_t id, uint8_t value, uint32_t nowMs)
+  {
+    removePending(id);
+    lastSent[id] = value;
+    sentMs[id] = nowMs;
+    return true;
+  }
+
+  // Function to remember the latest dropped value of a controller
+  // Returns false when the pending list is full
+  bool setPending(uint16_t id, uint8_t value, uint32_t dueMs)
+  {
+    for (int i = 0; i < pendingCount; i++)
+    {
+      if (pending[i].id == id)
+      {
+        pending[i].value = value;
+        pending[i].dueMs = dueMs;
+        return true;
+      }
+    }
+    if (pendingCount >= THIN_PENDING_MAX)
+      return false;
+    pending[pendingCount++] = {dueMs, id, value};
+    return true;
+  }
+
+  // Function to drop the pending value of a controller, if any
+  void removePending(uint16_t id)
+  {
+    for (int i = 0; i < pendingCount; i++)
+    {
+      if (pending[i].id == id)
+      {
+        pending[i] = pending[--pendingCount];
+        return;
+      }
+    }
+  }
+
+  uint8_t lastSent[THIN_CONTROLLERS];  // Last value on the wire, THIN_NONE = unknown
+  uint32_t sentMs[THIN_CONTROLLERS];   // millis() when it was sent
+  Pending pending[THIN_PENDING_MAX];
+  int pendingCount = 0;
+  uint32_t drops[DROP_REASONS] = {};
+  uint32_t flushed = 0;
+};
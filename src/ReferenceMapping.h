@@ -0,0 +1,238 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "MidiTypes.h"
+#include "MappingCompiler.h"
+
+// Reference mapping interpreter
+//
+// The original per-message JSON interpreter, kept as the model the compiled
+// tables are checked against ('fuzz'). It walks the document for every
+// message and fills a fixed output buffer, exactly as applyMapping() did
+// before mappings were compiled. Do not "fix" it: its quirks are the spec.
+//
+// Covers the original mapping format only (numbers, "type:num" strings,
+// arrays of those, objects with type/num/scale/velocity). Later additions
+// (ranges, timing, sources, note_gate, value) have no reference behaviour.
+
+// The interpreter stopped after this many array outputs
+const int REFERENCE_MAX_OUTPUTS = 10;
+
+// Output number the reference reports for targets outside 0-127
+const uint8_t REFERENCE_OUT_OF_RANGE = 0xFF;
+
+// Function to store a target number the way the harness needs to see it
+// The original wrote it into a uint8_t and the MIDI library sent the low 7
+// bits, so "note:200" played note 72 (and {"num": 200} fell back to the
+// input number). Such targets are marked instead, so the fuzzer can check
+// that the compiler rejects them.
+inline uint8_t referenceNumber(long number)
+{
+  return (number < 0 || number > 127) ? REFERENCE_OUT_OF_RANGE : number;
+}
+
+// Function to map one message the way the original interpreter did
+// outputs must hold REFERENCE_MAX_OUTPUTS entries
+// Returns true if mapping was applied, false if pass-through
+inline bool referenceMapping(JsonDocument &doc, const MidiData &midi, MappedOutput outputs[], int &outputCount)
+{
+  outputCount = 0;
+  for (int i = 0; i < REFERENCE_MAX_OUTPUTS; i++)
+    outputs[i] = {midi.type, 0, 0, 0, 0, 0, 0, THIN_OFF, 0};
+
+  String mapKey = getMappingKey(midi.type);
+  String inKey = String(midi.inNumber);
+
+  if (!doc.containsKey(mapKey))
+  {
+    // No mapping for this type, pass through
+    outputs[0].type = midi.type;
+    outputs[0].number = midi.inNumber;
+    outputs[0].value = midi.inValue;
+    outputCount = 1;
+    return false;
+  }
+
+  JsonObject map = doc[mapKey];
+
+  if (!map.containsKey(inKey))
+  {
+    // No mapping for this specific number, pass through
+    outputs[0].type = midi.type;
+    outputs[0].number = midi.inNumber;
+    outputs[0].value = midi.inValue;
+    outputCount = 1;
+    return false;
+  }
+
+  JsonVariant mapping = map[inKey];
+
+  // Handle different mapping types
+  if (mapping.is<int>())
+  {
+    // Simple number mapping: "12": 16 (same type)
+    outputs[0].type = midi.type;
+    outputs[0].number = referenceNumber(mapping.as<int>());
+    outputs[0].value = midi.inValue;
+    outputCount = 1;
+  }
+  else if (mapping.is<String>())
+  {
+    // String mapping for type conversion: "23": "note:45"
+    String mapStr = mapping.as<String>();
+    int colonPos = mapStr.indexOf(':');
+
+    if (colonPos > 0)
+    {
+      String typeStr = mapStr.substring(0, colonPos);
+      int targetNum = mapStr.substring(colonPos + 1).toInt();
+
+      // Determine output type
+      typeStr.toLowerCase();
+      if (typeStr == "cc")
+      {
+        outputs[0].type = MSG_CC;
+      }
+      else if (typeStr == "pc")
+      {
+        outputs[0].type = MSG_PC;
+      }
+      else if (typeStr == "note" || typeStr == "nn")
+      {
+        outputs[0].type = MSG_NOTE;
+      }
+      else
+      {
+        outputs[0].type = midi.type; // Unknown, keep same type
+      }
+
+      outputs[0].number = referenceNumber(targetNum);
+      outputs[0].value = midi.inValue;
+      outputCount = 1;
+    }
+    else
+    {
+      // No colon, treat as number
+      outputs[0].type = midi.type;
+      outputs[0].number = referenceNumber(mapStr.toInt());
+      outputs[0].value = midi.inValue;
+      outputCount = 1;
+    }
+  }
+  else if (mapping.is<JsonArray>())
+  {
+    // Array mapping (one-to-many): "12": [16, 17, "note:60"]
+    JsonArray arr = mapping.as<JsonArray>();
+    outputCount = 0;
+    for (JsonVariant v : arr)
+    {
+      if (outputCount >= REFERENCE_MAX_OUTPUTS)
+        break; // Max 10 outputs
+
+      if (v.is<int>())
+      {
+        // Simple number (same type)
+        outputs[outputCount].type = midi.type;
+        outputs[outputCount].number = referenceNumber(v.as<int>());
+        outputs[outputCount].value = midi.inValue;
+        outputCount++;
+      }
+      else if (v.is<String>())
+      {
+        // String with type conversion
+        String mapStr = v.as<String>();
+        int colonPos = mapStr.indexOf(':');
+
+        if (colonPos > 0)
+        {
+          String typeStr = mapStr.substring(0, colonPos);
+          int targetNum = mapStr.substring(colonPos + 1).toInt();
+
+          typeStr.toLowerCase();
+          if (typeStr == "cc")
+          {
+            outputs[outputCount].type = MSG_CC;
+          }
+          else if (typeStr == "pc")
+          {
+            outputs[outputCount].type = MSG_PC;
+          }
+          else if (typeStr == "note" || typeStr == "nn")
+          {
+            outputs[outputCount].type = MSG_NOTE;
+          }
+          else
+          {
+            outputs[outputCount].type = midi.type;
+          }
+
+          outputs[outputCount].number = referenceNumber(targetNum);
+          outputs[outputCount].value = midi.inValue;
+          outputCount++;
+        }
+      }
+    }
+  }
+  else if (mapping.is<JsonObject>())
+  {
+    // Object mapping with transformations: "12": {"type": "note", "num": 60, "scale": 0.5}
+    JsonObject obj = mapping.as<JsonObject>();
+
+    // Check for type conversion
+    if (obj.containsKey("type"))
+    {
+      String typeStr = obj["type"].as<String>();
+      typeStr.toLowerCase();
+      if (typeStr == "cc")
+      {
+        outputs[0].type = MSG_CC;
+      }
+      else if (typeStr == "pc")
+      {
+        outputs[0].type = MSG_PC;
+      }
+      else if (typeStr == "note" || typeStr == "nn")
+      {
+        outputs[0].type = MSG_NOTE;
+      }
+      else
+      {
+        outputs[0].type = midi.type;
+      }
+    }
+    else
+    {
+      outputs[0].type = midi.type; // Keep same type if not specified
+    }
+
+    outputs[0].number = referenceNumber(obj["num"] | (int)midi.inNumber); // Default to input if not specified
+
+    if (obj.containsKey("scale"))
+    {
+      float scale = obj["scale"];
+      outputs[0].value = scaleValue(midi.inValue, scale);
+    }
+    else if (obj.containsKey("velocity"))
+    {
+      float scale = obj["velocity"];
+      outputs[0].value = scaleValue(midi.inValue, scale);
+    }
+    else
+    {
+      outputs[0].value = midi.inValue;
+    }
+    outputCount = 1;
+  }
+
+  // Deviation: a PC has no value, so the original sent its note outputs with
+  // velocity 0, a note off. They now play at PC_NOTE_VELOCITY.
+  for (int i = 0; i < outputCount; i++)
+  {
+    uint8_t fixed = defaultOutputValue(midi.type, outputs[i].type);
+    if (fixed != VALUE_FROM_INPUT)
+      outputs[i].value = fixed;
+  }
+
+  return true;
+}
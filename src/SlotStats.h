@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "MappingTable.h"
+
+// Per-slot hit counters
+//
+// One record per (type, input number) slot of the mapping tables, so a
+// heavy preset can be profiled live: which entries fire most, which eat the
+// MIDI wire and which never fire. Only the MIDI loop writes the counters,
+// so they are plain increments and cheap enough to stay enabled.
+
+struct SlotStats
+{
+  uint32_t hits;      // Input messages
+  uint32_t outputs;   // Mapped outputs emitted (pass-through counts as one)
+  uint32_t bytes;     // MIDI bytes sent or scheduled, including gates and echoes
+  uint32_t lastHitMs; // millis() of the last input
+};
+
+class SlotCounters
+{
+public:
+  // Function to count an input message for a slot
+  void hit(int slot, uint32_t nowMs)
+  {
+    stats[slot].hits++;
+    stats[slot].lastHitMs = nowMs;
+  }
+
+  // Function to count one output of a slot and the bytes it puts on the wire
+  void emitted(int slot, uint16_t bytes)
+  {
+    stats[slot].outputs++;
+    stats[slot].bytes += bytes;
+  }
+
+  // Function to clear all counters
+  void reset(uint32_t nowMs)
+  {
+    memset(stats, 0, sizeof(stats));
+    startMs = nowMs;
+  }
+
+  // Function to find the slots with the most hits, most first
+  // Returns the number of slots written (slots that were never hit are skipped)
+  int top(int *slots, int maxCount) const
+  {
+    int count = 0;
+    for (int s = 0; s < MAP_SLOTS; s++)
+    {
+      if (stats[s].hits == 0)
+        continue;
+
+      // Insertion into the sorted list, dropping the last one when full
+      int pos = count;
+      while (pos > 0 && stats[slots[pos - 1]].hits < stats[s].hits)
+        pos--;
+      if (pos >= maxCount)
+        continue;
+      if (count < maxCount)
+        count++;
+      for (int i = count - 1; i > pos; i--)
+        slots[i] = slots[i - 1];
+      slots[pos] = s;
+    }
+    return count;
+  }
+
+  const SlotStats &operator[](int slot) const { return stats[slot]; }
+  uint32_t since() const { return startMs; }
+
+private:
+  SlotStats stats[MAP_SLOTS] = {};
+  uint32_t startMs = 0; // millis() of the last reset
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hashed timer wheel for delayed MIDI output
+//
+// Events are raw MIDI messages due at a given millisecond. Each event sits
+// in the bucket for (due % WHEEL_SIZE); advancing the wheel only visits the
+// buckets for the milliseconds that elapsed, so insert and fire are O(1)
+// no matter how many events are pending. Events more than WHEEL_SIZE ms
+// away simply stay in their bucket for another revolution. Each event can
+// carry a one-byte tag for the caller (see OutputScheduler.h).
+
+const uint16_t WHEEL_SIZE = 256;      // Buckets, 1ms each (power of two)
+const uint16_t WHEEL_CAPACITY = 512;  // Max pending events
+const uint16_t WHEEL_NIL = 0xFFFF;    // End of list / no event
+
+class TimerWheel
+{
+public:
+  TimerWheel()
+  {
+    clear();
+  }
+
+  // Function to drop all pending events
+  void clear()
+  {
+    for (uint16_t i = 0; i < WHEEL_SIZE; i++)
+      head[i] = tail[i] = WHEEL_NIL;
+    for (uint16_t i = 0; i < WHEEL_CAPACITY; i++)
+      events[i].next = (i + 1 < WHEEL_CAPACITY) ? i + 1 : WHEEL_NIL;
+    freeList = 0;
+    pendingCount = 0;
+    started = false;
+  }
+
+  // Function to schedule a MIDI message delayMs after nowMs
+  // Returns false (and counts a drop) when the pool is full
+  bool schedule(uint32_t nowMs, uint32_t delayMs, const uint8_t *bytes, uint8_t length, uint8_t tag = 0)
+  {
+    if (!started)
+      start(nowMs);
+
+    if (freeList == WHEEL_NIL)
+    {
+      dropped++;
+      return false;
+    }
+
+    uint16_t id = freeList;
+    Event &e = events[id];
+    freeList = e.next;
+
+    // Never schedule into a tick that has already been processed
+    uint32_t due = nowMs + delayMs;
+    if ((int32_t)(due - nextTick) < 0)
+      due = nextTick;
+
+    e.due = due;
+    e.length = length;
+    e.tag = tag;
+    for (uint8_t i = 0; i < length && i < 3; i++)
+      e.bytes[i] = bytes[i];
+
+    append(due & (WHEEL_SIZE - 1), id);
+    pendingCount++;
+    return true;
+  }
+
+  // Function to fire all events due up to nowMs
+  // fire(bytes, length, tag) is called for each event in due order
+  template <typename Fire>
+  void advance(uint32_t nowMs, Fire fire)
+  {
+    if (!started || pendingCount == 0)
+    {
+      nextTick = nowMs;
+      started = true;
+      return;
+    }
+
+    // After a long stall every bucket is visited once and everything due
+    // fires, in bucket order rather than due order
+    uint32_t steps = nowMs - nextTick + 1;
+    if ((int32_t)steps <= 0)
+      return;
+    if (steps > WHEEL_SIZE)
+      steps = WHEEL_SIZE;
+
+    // The current tick stays open: events scheduled later in this same
+    // millisecond are still fired by the next call
+    uint32_t tick = nextTick;
+    nextTick = nowMs;
+
+    for (uint32_t s = 0; s < steps && pendingCount > 0; s++, tick++)
+    {
+      uint16_t bucket = tick & (WHEEL_SIZE - 1);
+      uint16_t id = head[bucket];
+      head[bucket] = tail[bucket] = WHEEL_NIL;
+
+      while (id != WHEEL_NIL)
+      {
+        Event &e = events[id];
+        uint16_t next = e.next;
+
+        if ((int32_t)(e.due - nowMs) <= 0)
+        {
+          fire(e.bytes, e.length, e.tag);
+          e.next = freeList;
+          freeList = id;
+          pendingCount--;
+        }
+        else
+        {
+          append(bucket, id); // Due in a later revolution
+        }
+        id = next;
+      }
+    }
+  }
+
+  uint16_t pending() const { return pendingCount; }
+  uint32_t drops() const { return dropped; }
+
+private:
+  struct Event
+  {
+    uint32_t due;     // millis() when the event fires
+    uint16_t next;    // Next event in the bucket or free list
+    uint8_t bytes[3]; // MIDI message
+    uint8_t length;
+    uint8_t tag;      // Caller's tag, 0 = none
+  };
+
+  void start(uint32_t nowMs)
+  {
+    nextTick = nowMs;
+    started = true;
+  }
+
+  void append(uint16_t bucket, uint16_t id)
+  {
+    events[id].next = WHEEL_NIL;
+    if (tail[bucket] == WHEEL_NIL)
+      head[bucket] = id;
+    else
+      events[tail[bucket]].next = id;
+    tail[bucket] = id;
+  }
+
+  Event events[WHEEL_CAPACITY];
+  uint16_t head[WHEEL_SIZE];
+  uint16_t tail[WHEEL_SIZE];
+  uint16_t freeList = 0;
+  uint16_t pendingCount = 0;
+  uint32_t nextTick = 0; // First tick not yet fully processed
+  uint32_t dropped = 0;
+  bool started = false;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+// Small, fast pseudo-random numbers for test traffic and benchmarks
+// (xorshift32). Not for anything that needs good randomness.
+
+// Function to advance a xorshift state and return the new value
+// The state must not be 0
+inline uint32_t xorshift32(uint32_t &state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
@@ -2,6 +2,22 @@
 #include <ArduinoJson.h>
 #include "DisplayDrv_st7789.h"
 #include "globals.h"
+#include "MidiTypes.h"
+#include "MappingTable.h"
+#include "MappingCompiler.h"
+#include "MappingPatch.h"
+#include "DefaultMapping.h"
+#include "MidiParser.h"
+#include "MidiMerger.h"
+#include "TimerWheel.h"
+#include "OutputScheduler.h"
+#include "OutputThinner.h"
+#include "EventLog.h"
+#include "SlotStats.h"
+#include "LoadGenerator.h"
+#include "LoopProfiler.h"
+#include "Benchmarks.h"
+#include "MappingFuzz.h"
 
 // Create display instance
 LGFX_ST7789 tft;
@@ -39,28 +55,11 @@ const char *NOTE_NAMES[] = {
     "C8", "C#8", "D8", "D#8", "E8", "F8", "F#8", "G8", "G#8", "A8", "A#8", "B8",
     "C9", "C#9", "D9", "D#9", "E9", "F9", "F#9", "G9"};
 
-// MIDI message types
-enum MidiMessageType
-{
-  MSG_CC = 0,  // Control Change
-  MSG_PC = 1,  // Program Change
-  MSG_NOTE = 2 // Note
-};
-
-// Current MIDI data
-struct MidiData
-{
-  MidiMessageType type;
-  uint8_t inNumber;  // CC number, PC number, or Note number
-  uint8_t inValue;   // CC value, or Note velocity
-  uint8_t outNumber; // Mapped CC/PC/Note number
-  uint8_t outValue;  // Mapped value
-};
-
-MidiData currentMidi = {MSG_CC, 12, 123, 16, 40};
+MidiData currentMidi = {MSG_CC, 12, 123, 16, 40, SRC_DIN};
 
-// Demo mode control
-bool demoEnabled = false; // Set to false to disable demo and use serial commands only
+// Demo mode: slow mixed traffic from the load generator
+bool demoEnabled = false; // Set to true to start with the demo running
+const uint32_t DEMO_RATE = 2; // Messages per second
 
 // LED indicator variables
 unsigned long ledOnTime = 0;
@@ -74,323 +73,186 @@ const int LED_RADIUS = 5; // LED circle radius
 JsonDocument mapDoc;
 bool mappingEnabled = true;
 
-// Default mapping JSON (example with type conversion)
-const char *defaultMapping = R"({
-  "cc_map": {
-    "12": 16,
-    "23": "note:45",
-    "74": [71, 72, "note:60"],
-    "1": {"type": "note", "num": 64, "scale": 1.0},
-    "7": {"num": 77, "scale": 0.8}
-  },
-  "pc_map": {
-    "0": 10,
-    "5": ["cc:74", "note:60"],
-    "10": {"type": "cc", "num": 100}
-  },
-  "note_map": {
-    "60": 64,
-    "62": ["cc:74", "note:67"],
-    "72": {"type": "cc", "num": 76, "velocity": 1.2}
-  }
-})";
-
-// Output structure for multiple mappings
-struct MappedOutput
-{
-  MidiMessageType type; // Output message type (can be different from input)
-  uint8_t number;
-  uint8_t value;
-};
-
-// Function to apply value scaling/transformation
-uint8_t scaleValue(uint8_t inputValue, float scale)
-{
-  int scaled = (int)(inputValue * scale);
-  if (scaled > 127)
-    scaled = 127;
-  if (scaled < 0)
-    scaled = 0;
-  return (uint8_t)scaled;
-}
-
-// Function to get mapping key based on message type
-String getMappingKey(MidiMessageType type)
-{
-  switch (type)
-  {
-  case MSG_CC:
-    return "cc_map";
-  case MSG_PC:
-    return "pc_map";
-  case MSG_NOTE:
-    return "note_map";
-  default:
-    return "";
-  }
-}
+// Active compiled mapping: built-in flash tables until a user mapping is loaded
+MappingTable activeMapping = DEFAULT_MAPPING.table();
+RuntimeMapping *userMapping = nullptr; // Allocated only when a JSON mapping is loaded
+uint8_t heldNoteZones[MAP_NUMBERS];    // Zone of each sounding note, for its note off
+SlotCounters slotCounters;             // Hit counters per mapping slot ('stats')
 
 // Function to apply mapping
+// Calls emit(const MappedOutput &) for every output of the active mapping
 // Returns true if mapping was applied, false if pass-through
-bool applyMapping(MidiData &midi, MappedOutput outputs[], int &outputCount)
+template <typename Emit>
+bool applyMapping(const MidiData &midi, Emit emit)
 {
-  outputCount = 0;
-
   if (!mappingEnabled)
   {
     // Pass-through mode
-    outputs[0].type = midi.type;
-    outputs[0].number = midi.inNumber;
-    outputs[0].value = midi.inValue;
-    outputCount = 1;
+    MappedOutput o = {midi.type, midi.inNumber, midi.inValue, 0, 0, 0, 0, THIN_OFF, 0};
+    emit(o);
     return false;
   }
 
-  String mapKey = getMappingKey(midi.type);
-  String inKey = String(midi.inNumber);
+  uint8_t *held = (midi.type == MSG_NOTE) ? heldNoteZones : nullptr;
+  return mapMessage(activeMapping, midi, held, emit);
+}
 
-  if (!mapDoc.containsKey(mapKey))
-  {
-    // No mapping for this type, pass through
-    outputs[0].type = midi.type;
-    outputs[0].number = midi.inNumber;
-    outputs[0].value = midi.inValue;
-    outputCount = 1;
-    return false;
-  }
+// Function to switch back to the built-in mapping and free the user mapping
+void useDefaultMapping()
+{
+  activeMapping = DEFAULT_MAPPING.table();
+  memset(heldNoteZones, ZONE_NONE, sizeof(heldNoteZones));
+  delete userMapping;
+  userMapping = nullptr;
+  mapDoc.clear();
+  mappingEnabled = true;
+  Serial.println("✓ Built-in default mapping active");
+}
+
+// Mapping patches from the config UI arrive as binary frames on the USB
+// serial port: PATCH_FRAME_START, 16-bit little-endian length, MessagePack
+// payload. Acknowledgements go back in the same framing. Text commands
+// never contain the start byte.
+const uint8_t PATCH_FRAME_START = 0x02;       // ASCII STX
+const uint16_t PATCH_FRAME_MAX = 1024;
+const uint32_t PATCH_FRAME_TIMEOUT_MS = 500; // Silence that abandons an incomplete frame
+const size_t PATCH_ACK_MAX = 64;             // Ack frame size, including the 3-byte header
+const size_t PATCH_ID_MAX = 24;              // Encoded "id" size that always fits in an ack
+
+// Patch frame being received, built up over several loop() passes
+struct PatchFrameReader
+{
+  uint8_t payload[PATCH_FRAME_MAX];
+  uint16_t length;   // Payload length from the header
+  uint32_t received; // Bytes after the start byte: 2 header bytes, then payload
+  uint32_t lastByteMs;
+  bool active;
+};
+PatchFrameReader patchFrame = {};
 
-  JsonObject map = mapDoc[mapKey];
+// Function to make sure there is a user mapping for patches to edit
+// Starts from the built-in mapping, compiled from its JSON form
+// Returns false if it could not be built or compiled (out of memory); the
+// built-in tables then stay active
+bool ensureUserMapping()
+{
+  if (userMapping != nullptr)
+    return true;
 
-  if (!map.containsKey(inKey))
+  RuntimeMapping *mapping = new RuntimeMapping();
+  if (!defaultMappingDocument(mapDoc) || !compileMapping(mapDoc, *mapping))
   {
-    // No mapping for this specific number, pass through
-    outputs[0].type = midi.type;
-    outputs[0].number = midi.inNumber;
-    outputs[0].value = midi.inValue;
-    outputCount = 1;
+    Serial.println("✗ Could not load the mapping to patch: out of memory");
+    delete mapping;
+    mapDoc.clear();
     return false;
   }
 
-  JsonVariant mapping = map[inKey];
+  userMapping = mapping;
+  activeMapping = userMapping->table();
+  memset(heldNoteZones, ZONE_NONE, sizeof(heldNoteZones));
+  return true;
+}
+
+// Function to send a patch acknowledgement frame: {"id", "ok", "err", "us"}
+// An id too long for the frame is sent back as null rather than cut short
+void sendPatchAck(JsonVariant id, PatchResult result, uint32_t elapsedUs)
+{
+  JsonDocument ack;
+  ack["id"] = id;
+  ack["ok"] = (result == PATCH_OK);
+  if (result != PATCH_OK)
+    ack["err"] = PATCH_RESULT_NAMES[result];
+  ack["us"] = elapsedUs;
+  if (measureMsgPack(ack) > PATCH_ACK_MAX - 3)
+    ack["id"] = nullptr;
+
+  uint8_t frame[PATCH_ACK_MAX];
+  size_t len = serializeMsgPack(ack, frame + 3, sizeof(frame) - 3);
+  frame[0] = PATCH_FRAME_START;
+  frame[1] = len & 0xFF;
+  frame[2] = len >> 8;
+  Serial.write(frame, len + 3);
+}
 
-  // Handle different mapping types
-  if (mapping.is<int>())
+// Function to apply one complete patch frame
+// Only the slots of the patched entry are recompiled; MIDI keeps flowing
+void handlePatchFrame(const uint8_t *payload, uint16_t len)
+{
+  JsonDocument patch;
+  if (len > PATCH_FRAME_MAX || deserializeMsgPack(patch, payload, len))
   {
-    // Simple number mapping: "12": 16 (same type)
-    outputs[0].type = midi.type;
-    outputs[0].number = mapping.as<int>();
-    outputs[0].value = midi.inValue;
-    outputCount = 1;
+    sendPatchAck(patch["id"], PATCH_BAD_REQUEST, 0);
+    return;
   }
-  else if (mapping.is<String>())
-  {
-    // String mapping for type conversion: "23": "note:45"
-    String mapStr = mapping.as<String>();
-    int colonPos = mapStr.indexOf(':');
-
-    if (colonPos > 0)
-    {
-      String typeStr = mapStr.substring(0, colonPos);
-      int targetNum = mapStr.substring(colonPos + 1).toInt();
-
-      // Determine output type
-      typeStr.toLowerCase();
-      if (typeStr == "cc")
-      {
-        outputs[0].type = MSG_CC;
-      }
-      else if (typeStr == "pc")
-      {
-        outputs[0].type = MSG_PC;
-      }
-      else if (typeStr == "note" || typeStr == "nn")
-      {
-        outputs[0].type = MSG_NOTE;
-      }
-      else
-      {
-        outputs[0].type = midi.type; // Unknown, keep same type
-      }
 
-      outputs[0].number = targetNum;
-      outputs[0].value = midi.inValue;
-      outputCount = 1;
-    }
-    else
-    {
-      // No colon, treat as number
-      outputs[0].type = midi.type;
-      outputs[0].number = mapStr.toInt();
-      outputs[0].value = midi.inValue;
-      outputCount = 1;
-    }
-  }
-  else if (mapping.is<JsonArray>())
+  // The client could not match the ack to the patch: refuse to apply it
+  if (measureMsgPack(patch["id"]) > PATCH_ID_MAX)
   {
-    // Array mapping (one-to-many): "12": [16, 17, "note:60"]
-    JsonArray arr = mapping.as<JsonArray>();
-    outputCount = 0;
-    for (JsonVariant v : arr)
-    {
-      if (outputCount >= 10)
-        break; // Max 10 outputs
-
-      if (v.is<int>())
-      {
-        // Simple number (same type)
-        outputs[outputCount].type = midi.type;
-        outputs[outputCount].number = v.as<int>();
-        outputs[outputCount].value = midi.inValue;
-        outputCount++;
-      }
-      else if (v.is<String>())
-      {
-        // String with type conversion
-        String mapStr = v.as<String>();
-        int colonPos = mapStr.indexOf(':');
-
-        if (colonPos > 0)
-        {
-          String typeStr = mapStr.substring(0, colonPos);
-          int targetNum = mapStr.substring(colonPos + 1).toInt();
-
-          typeStr.toLowerCase();
-          if (typeStr == "cc")
-          {
-            outputs[outputCount].type = MSG_CC;
-          }
-          else if (typeStr == "pc")
-          {
-            outputs[outputCount].type = MSG_PC;
-          }
-          else if (typeStr == "note" || typeStr == "nn")
-          {
-            outputs[outputCount].type = MSG_NOTE;
-          }
-          else
-          {
-            outputs[outputCount].type = midi.type;
-          }
-
-          outputs[outputCount].number = targetNum;
-          outputs[outputCount].value = midi.inValue;
-          outputCount++;
-        }
-      }
-    }
+    sendPatchAck(JsonVariant(), PATCH_BAD_REQUEST, 0);
+    return;
   }
-  else if (mapping.is<JsonObject>())
-  {
-    // Object mapping with transformations: "12": {"type": "note", "num": 60, "scale": 0.5}
-    JsonObject obj = mapping.as<JsonObject>();
-
-    // Check for type conversion
-    if (obj.containsKey("type"))
-    {
-      String typeStr = obj["type"].as<String>();
-      typeStr.toLowerCase();
-      if (typeStr == "cc")
-      {
-        outputs[0].type = MSG_CC;
-      }
-      else if (typeStr == "pc")
-      {
-        outputs[0].type = MSG_PC;
-      }
-      else if (typeStr == "note" || typeStr == "nn")
-      {
-        outputs[0].type = MSG_NOTE;
-      }
-      else
-      {
-        outputs[0].type = midi.type;
-      }
-    }
-    else
-    {
-      outputs[0].type = midi.type; // Keep same type if not specified
-    }
 
-    outputs[0].number = obj["num"] | midi.inNumber; // Default to input if not specified
+  uint32_t start = micros();
+  if (!ensureUserMapping())
+  {
+    sendPatchAck(patch["id"], PATCH_NO_MEMORY, micros() - start);
+    return;
+  }
+  PatchedRange changed;
+  PatchResult result = applyPatch(mapDoc, *userMapping, patch.as<JsonVariant>(), changed);
+  activeMapping = userMapping->table(); // The arena may have moved
 
-    if (obj.containsKey("scale"))
-    {
-      float scale = obj["scale"];
-      outputs[0].value = scaleValue(midi.inValue, scale);
-    }
-    else if (obj.containsKey("velocity"))
-    {
-      float scale = obj["velocity"];
-      outputs[0].value = scaleValue(midi.inValue, scale);
-    }
-    else
-    {
-      outputs[0].value = midi.inValue;
-    }
-    outputCount = 1;
+  // Sounding notes of a rebuilt slot can no longer rely on their zone
+  if (result == PATCH_OK && changed.type == MSG_NOTE)
+  {
+    for (int n = changed.lo; n <= changed.hi; n++)
+      heldNoteZones[n] = ZONE_NONE;
   }
 
-  return true;
+  sendPatchAck(patch["id"], result, micros() - start);
 }
 
-// Function to load JSON mapping
-void loadMapping(const char *jsonString)
+// Function to take the waiting bytes of a patch frame without blocking
+// A frame is applied once complete; oversized payloads are skipped to stay
+// in sync. Returns true while the serial port belongs to a frame
+bool receivePatchFrame()
 {
-  DeserializationError error = deserializeJson(mapDoc, jsonString);
-
-  if (error)
+  PatchFrameReader &f = patchFrame;
+  if (!f.active)
   {
-    Serial.print("JSON parsing failed: ");
-    Serial.println(error.c_str());
-    mappingEnabled = false;
-    return;
+    if (Serial.available() == 0 || Serial.peek() != PATCH_FRAME_START)
+      return false;
+    Serial.read();
+    f.length = 0;
+    f.received = 0;
+    f.lastByteMs = millis();
+    f.active = true;
   }
 
-  Serial.println("✓ Mapping loaded successfully");
-  mappingEnabled = true;
-
-  // Print loaded mappings
-  Serial.println("\n=== Current Mappings ===");
-  if (mapDoc.containsKey("cc_map"))
+  while (Serial.available() > 0 && (f.received < 2 || f.received - 2 < f.length))
   {
-    Serial.println("CC Mappings:");
-    JsonObject ccMap = mapDoc["cc_map"];
-    for (JsonPair kv : ccMap)
-    {
-      Serial.print("  CC");
-      Serial.print(kv.key().c_str());
-      Serial.print(" -> ");
-      serializeJson(kv.value(), Serial);
-      Serial.println();
-    }
+    uint8_t b = Serial.read();
+    if (f.received < 2)
+      f.length |= b << (8 * f.received);
+    else if (f.received - 2 < PATCH_FRAME_MAX)
+      f.payload[f.received - 2] = b;
+    f.received++;
+    f.lastByteMs = millis();
   }
-  if (mapDoc.containsKey("pc_map"))
+
+  if (f.received >= 2 && f.received - 2 == f.length)
   {
-    Serial.println("PC Mappings:");
-    JsonObject pcMap = mapDoc["pc_map"];
-    for (JsonPair kv : pcMap)
-    {
-      Serial.print("  PC");
-      Serial.print(kv.key().c_str());
-      Serial.print(" -> ");
-      serializeJson(kv.value(), Serial);
-      Serial.println();
-    }
+    f.active = false;
+    handlePatchFrame(f.payload, f.length);
   }
-  if (mapDoc.containsKey("note_map"))
+  else if (millis() - f.lastByteMs >= PATCH_FRAME_TIMEOUT_MS)
   {
-    Serial.println("Note Mappings:");
-    JsonObject noteMap = mapDoc["note_map"];
-    for (JsonPair kv : noteMap)
-    {
-      Serial.print("  Note ");
-      Serial.print(kv.key().c_str());
-      Serial.print(" -> ");
-      serializeJson(kv.value(), Serial);
-      Serial.println();
-    }
+    // Bytes were lost: give up on the frame and look for the next one
+    f.active = false;
+    sendPatchAck(JsonVariant(), PATCH_BAD_REQUEST, 0);
   }
-  Serial.println("=======================\n");
+  return true;
 }
 
 // Function to turn LED on (green circle)
@@ -476,20 +338,351 @@ void updateDisplay()
   ledOn();
 }
 
-void setup()
+// ---------------------------------------------------------------------------
+// MIDI I/O (Serial1)
+
+MidiMerger midiMerger; // DIN and USB inputs, merged in arrival order
+TimerWheel outputQueue; // Delayed outputs, note offs and echoes
+NoteGenerations noteGens; // Gate note offs are dropped once their note is struck again
+uint32_t staleNoteOffs = 0; // Gate note offs dropped that way
+OutputThinner thinner;  // Last sent CC values for "dedupe" outputs ('thin')
+EventLog eventLog;      // MIDI events for the serial console ('log')
+bool logRaw = false;    // Send log records as binary frames instead of text
+uint32_t logDropsReported = 0; // eventLog.drops() at the last drop message
+LoadGenerator loadGen;  // Synthetic input for 'load' and the demo mode
+LoopProfiler profiler;  // CPU time per loop() stage ('cpu')
+bool cpuMeterEnabled = false;    // Show the CPU load on the display
+uint32_t cpuMeterDrawnWindow = 0; // Profiler window the meter shows
+uint32_t midiBytesOut = 0;      // Bytes written to the MIDI output
+uint32_t loadStartBytesOut = 0; // midiBytesOut when the load run started
+bool displayPending = false; // currentMidi changed by MIDI input, redraw when possible
+unsigned long lastMidiDisplay = 0;
+const int MIDI_DISPLAY_INTERVAL = 40;  // Max display refresh rate for MIDI input (ms)
+const int MIDI_RX_BUFFER_SIZE = 1024;  // ~330ms of MIDI at 31250 baud, covers a stalled loop
+const int MIDI_POLL_PASSES = 4;        // Max refills of a full DIN queue per loop()
+
+// Boot phases, timestamped in micros() since reset
+enum BootPhase
 {
-  Serial.begin(115200);
-  delay(500);
-  Serial.println("ESP32-C3 ST7789 Display Test");
+  BOOT_SETUP = 0,    // setup() entered
+  BOOT_MIDI_LIVE,    // Serial1 RX->map->TX path running
+  BOOT_SERIAL,       // USB serial started
+  BOOT_DISPLAY_INIT, // Display controller initialized
+  BOOT_UI_DRAWN,     // Static UI drawn
+  BOOT_READY,        // Everything up, serial commands accepted
+  BOOT_PHASE_COUNT
+};
 
-  // Initialize Serial1 for MIDI (optional, for future use)
-  Serial1.begin(31250, SERIAL_8N1, MIDI_RX_PIN, MIDI_TX_PIN);
-  Serial.println("MIDI Serial1 initialized on TX:GPIO6, RX:GPIO7");
+const char *BOOT_PHASE_NAMES[BOOT_PHASE_COUNT] = {
+    "setup()", "MIDI live", "USB serial", "Display init", "UI drawn", "Ready"};
 
-  // Initialize display
-  tft.init();
-  Serial.println("Display initialized");
+// micros() starts when the app starts: ROM and bootloader time before it is not counted
+const unsigned long BOOT_MIDI_LIVE_TARGET_US = 50000; // MIDI must pass through within 50ms of reset
+const unsigned long BOOT_FORWARD_TARGET_US = 20000;   // Worst DIN RX->TX latency while booting
+
+unsigned long bootTimeUs[BOOT_PHASE_COUNT] = {0};
+unsigned long bootWorstForwardUs[BOOT_PHASE_COUNT] = {0}; // Worst DIN RX->TX latency right after each phase
+volatile BootPhase bootPhase = BOOT_SETUP; // Also advanced by the display init task
+unsigned long firstMidiRxUs = 0;  // First byte read from Serial1
+unsigned long firstMidiTxUs = 0;  // First DIN input forwarded
+unsigned long lastMidiPollUs = 0; // Last time Serial1 was read; waiting bytes arrived after it
+
+const uint32_t DISPLAY_INIT_STACK_SIZE = 4096;            // Bytes for the display init task
+const UBaseType_t DISPLAY_INIT_PRIORITY = tskIDLE_PRIORITY; // Below the loop task (priority 1)
+bool displayInitStarted = false;
+
+// Function to record reaching a boot phase
+void markBootPhase(BootPhase phase)
+{
+  bootTimeUs[phase] = micros();
+  bootPhase = phase;
+}
+
+// Function to write raw bytes to the MIDI output
+// tag links a gated note on to its scheduled note off (0 = none)
+void sendMidiBytes(const uint8_t *bytes, size_t length, uint8_t tag = 0)
+{
+  StageScope stage(profiler, STAGE_MIDI_OUT);
+  Serial1.write(bytes, length);
+  midiBytesOut += length;
+  if (length == 3 && (bytes[0] & 0xF0) == 0xB0)
+    thinner.noteSent(bytes[0] & 0x0F, bytes[1], bytes[2], millis()); // Keep the dedupe cache in step with the wire
+  noteGens.sent(bytes, length, tag); // A note on makes pending gate offs of the same note stale
+}
+
+// Function to send one mapped output, scheduling delayed parts on the timer wheel
+// Returns the number of bytes sent or scheduled (not those lost on a full timer wheel)
+uint16_t sendMidiOutput(const MappedOutput &out, uint8_t channel)
+{
+  unsigned long now = millis();
+
+  // Immediate CC outputs of "dedupe" mappings skip values the receiver already has
+  if (out.type == MSG_CC && out.deadband != THIN_OFF && out.delayMs == 0 && out.repeat == 0 &&
+      !thinner.admit(channel, out.number & 0x7F, out.value & 0x7F, out.deadband, out.minGapMs, now))
+    return 0;
+
+  return scheduleMidiOutput(out, channel, now, outputQueue, noteGens, sendMidiBytes,
+                            [&](const uint8_t *bytes, uint8_t length)
+                            {
+                              if (eventLog.enabled(LOG_ERROR))
+                                eventLog.append(LOG_SCHED_FULL, SRC_COUNT, out.type, length, bytes[0], micros());
+                            });
+}
+
+// Function to send scheduled outputs and held-back CC values that are due
+void serviceOutputQueue()
+{
+  unsigned long now = millis();
+  staleNoteOffs += fireDueOutputs(outputQueue, noteGens, now, sendMidiBytes);
+  thinner.flush(now, [](uint8_t channel, uint8_t number, uint8_t value)
+                {
+                  uint8_t bytes[3] = {(uint8_t)(0xB0 | channel), number, value};
+                  sendMidiBytes(bytes, 3); });
+}
+
+// Function to print a logged input (DIN and generated inputs are marked, host events are not)
+void printMappedInput(const LogRecord &in)
+{
+  Serial.print(in.source == SRC_DIN ? "✓ DIN " : in.source == SRC_GEN ? "✓ GEN " : "✓ ");
+  switch (in.type)
+  {
+  case MSG_CC:
+    Serial.printf("CC%d Value:%d -> ", in.number, in.value);
+    break;
+  case MSG_PC:
+    Serial.printf("PC%d -> ", in.number);
+    break;
+  case MSG_NOTE:
+    Serial.printf("Note %s Vel:%d -> ", NOTE_NAMES[in.number & 0x7F], in.value);
+    break;
+  }
+}
+
+// Function to print one logged output of an input
+void printMappedOutput(const LogRecord &out, bool first)
+{
+  if (!first)
+    Serial.print(", ");
+
+  switch (out.type)
+  {
+  case MSG_CC:
+    Serial.printf("CC%d:%d", out.number, out.value);
+    break;
+  case MSG_PC:
+    Serial.printf("PC%d", out.number);
+    break;
+  case MSG_NOTE:
+    Serial.printf("Note %s:%d", NOTE_NAMES[out.number & 0x7F], out.value);
+    break;
+  }
+}
+
+// Event log drain limits
+const int LOG_DRAIN_MAX = 32;         // Most records written per loop()
+const int LOG_LINE_ROOM = 64;         // Free USB TX bytes needed before writing a record
+const uint8_t LOG_FRAME_START = 0x03; // Starts a raw log frame ('log raw')
+
+// Function to map and forward one merged MIDI event
+// CC, PC and Note messages go through the mapping, everything else passes through
+void handleMidiEvent(const MidiEvent &ev)
+{
+  const MidiMessage &msg = ev.msg;
+  uint8_t channel = msg.bytes[0] & 0x0F;
+  MidiData midi;
+
+  // Generated load stands in for DIN input, so "source": "din" entries react to it
+  if (!decodeMidiMessage(msg, ev.source == SRC_GEN ? SRC_DIN : ev.source, midi))
+  {
+    // Real-time, SysEx, pitch bend, aftertouch, ...: forward untouched
+    sendMidiBytes(msg.bytes, msg.length);
+    if (eventLog.enabled(ev.source == SRC_USB ? LOG_INFO : LOG_DEBUG))
+      eventLog.append(LOG_FORWARD, ev.source, 0, msg.length, msg.bytes[0], micros());
+    return;
+  }
+
+  // Only records go to the log here; drainEventLog() prints them later
+  bool echo = eventLog.enabled(ev.source == SRC_USB ? LOG_INFO : LOG_DEBUG);
+  if (echo)
+    eventLog.append(LOG_MIDI_IN, ev.source, midi.type, midi.inNumber, midi.inValue, micros());
+
+  int slot = slotIndex(midi.type, midi.inNumber);
+  slotCounters.hit(slot, millis());
+
+  StageScope stage(profiler, STAGE_MAPPING);
+  int outputCount = 0;
+  applyMapping(midi, [&](const MappedOutput &out)
+               {
+                 slotCounters.emitted(slot, sendMidiOutput(out, channel));
+                 if (echo)
+                   eventLog.append(LOG_MIDI_OUT, ev.source, out.type, out.number, out.value, micros());
+
+                 // Remember the first output for the display, drawn later from loop()
+                 if (outputCount++ == 0)
+                 {
+                   currentMidi = midi;
+                   currentMidi.type = out.type;
+                   currentMidi.outNumber = out.number;
+                   currentMidi.outValue = out.value;
+                   displayPending = true;
+                 } });
+
+  if (echo)
+    eventLog.append(LOG_MIDI_END, ev.source, midi.type, 0, (uint8_t)min(outputCount, 255), micros());
+}
+
+// Function to print logged events while the USB port has room for them
+// Runs last in loop(): a slow or absent host only fills the ring, it never
+// blocks MIDI. Returns true if anything was written
+bool drainEventLog()
+{
+  static bool lineOpen = false; // An input was printed, its outputs follow
+  static int lineOutputs = 0;
+  bool worked = false;
+
+  // Tell the console once the ring has lost records
+  uint32_t drops = eventLog.drops();
+  if (drops != logDropsReported && !logRaw && Serial.availableForWrite() >= LOG_LINE_ROOM)
+  {
+    Serial.printf("%s✗ Log: %lu record(s) dropped\n", lineOpen ? "\n" : "", (unsigned long)(drops - logDropsReported));
+    logDropsReported = drops;
+    lineOpen = false;
+    worked = true;
+  }
+
+  LogRecord r;
+  for (int n = 0; n < LOG_DRAIN_MAX && Serial.availableForWrite() >= LOG_LINE_ROOM && eventLog.take(r); n++)
+  {
+    worked = true;
+    if (logRaw)
+    {
+      Serial.write(LOG_FRAME_START);
+      Serial.write((const uint8_t *)&r, sizeof(r));
+      continue;
+    }
+
+    switch (r.kind)
+    {
+    case LOG_MIDI_IN:
+      if (lineOpen)
+        Serial.println(); // Its end record was dropped
+      printMappedInput(r);
+      lineOpen = true;
+      lineOutputs = 0;
+      break;
+    case LOG_MIDI_OUT:
+      if (lineOpen)
+        printMappedOutput(r, lineOutputs++ == 0);
+      break;
+    case LOG_MIDI_END:
+      if (lineOpen)
+        Serial.println();
+      lineOpen = false;
+      break;
+    case LOG_FORWARD:
+      Serial.printf("%s✓ %sForwarded %d byte(s)\n", lineOpen ? "\n" : "", r.source == SRC_DIN ? "DIN " : r.source == SRC_GEN ? "GEN " : "", r.number);
+      lineOpen = false;
+      break;
+    case LOG_SCHED_FULL:
+      Serial.printf("%s✗ Output queue full: %d byte(s) dropped (status %02X)\n", lineOpen ? "\n" : "", r.number, r.value);
+      lineOpen = false;
+      break;
+    }
+  }
+  return worked;
+}
+
+// Function to read waiting DIN bytes into the merger
+// Stops while the DIN queue is full; the rest stays in the UART buffer
+// Returns the number of bytes read
+int pollMidiSources()
+{
+  int count = 0;
+  while (Serial1.available() > 0 && midiMerger.hasSpace(SRC_DIN))
+  {
+    uint8_t b = Serial1.read();
+    uint32_t now = micros();
+    if (firstMidiRxUs == 0)
+      firstMidiRxUs = now;
+    midiMerger.feed(SRC_DIN, b, now);
+    count++;
+  }
+  return count;
+}
+
+// Function to record the forwarding of DIN input that waited since waitingSinceUs
+// During boot the worst latency is kept per phase, to catch phases that
+// block the loop while MIDI waits in the UART buffer
+void recordDinForward(uint32_t waitingSinceUs)
+{
+  uint32_t now = micros();
+  BootPhase phase = bootPhase;
+  if (firstMidiTxUs == 0)
+    firstMidiTxUs = now;
+  if (phase != BOOT_READY && now - waitingSinceUs > bootWorstForwardUs[phase])
+    bootWorstForwardUs[phase] = now - waitingSinceUs;
+}
+
+// Function to process all input waiting on every MIDI source
+// Returns the number of messages handled
+int processMidiInput()
+{
+  MidiEvent ev;
+  int passes = 0;
+  int handled = 0;
+  int dinBytes = 0;
+
+  // Bytes waiting in the UART arrived after the last read, but may have
+  // waited since then: the latency is measured from there
+  uint32_t waitingSinceUs = lastMidiPollUs;
+  lastMidiPollUs = micros();
+  do
+  {
+    dinBytes += pollMidiSources();
+    while (midiMerger.pop(ev, micros()))
+    {
+      handleMidiEvent(ev);
+      if (ev.source == SRC_GEN)
+        loadGen.recordLatency(micros() - ev.timeUs);
+      handled++;
+    }
+  } while (Serial1.available() > 0 && ++passes < MIDI_POLL_PASSES);
+
+  if (dinBytes > 0)
+    recordDinForward(waitingSinceUs);
+  if (Serial1.available() > 0)
+    lastMidiPollUs = waitingSinceUs; // Bytes left behind have been waiting since then
+  return handled;
+}
+
+// Function to start the load generator
+void startLoad(LoadPattern pattern, uint32_t rate, uint32_t durationMs)
+{
+  loadStartBytesOut = midiBytesOut;
+  loadGen.start(pattern, rate, durationMs, micros());
+}
 
+// Function to feed due load generator traffic into the merger
+// Prints the report when a timed load run ends
+void serviceLoadGenerator()
+{
+  if (!loadGen.running())
+    return;
+  if (!loadGen.service(midiMerger, micros()) && !demoEnabled)
+    loadGen.printReport(midiBytesOut - loadStartBytesOut);
+}
+
+// Function to queue a message typed on the host as a USB source event
+void injectHostMessage(uint8_t status, uint8_t data1, uint8_t data2, uint8_t length)
+{
+  MidiMessage msg = {{status, data1, data2}, length};
+  if (!midiMerger.push(SRC_USB, msg, micros()))
+    Serial.println("✗ Error: USB input queue full");
+}
+
+// Function to draw the static parts of the UI
+void drawStaticUI()
+{
   // Set rotation (0-3)
   tft.setRotation(1); // Landscape mode
 
@@ -523,18 +716,238 @@ void setup()
 
   // Initialize LED indicator in off state
   ledOff();
+}
+
+// Function to print boot phase timing
+void printBootReport()
+{
+  Serial.println("\n=== Boot Timing ===");
+  Serial.println("Phase         :  reached     worst DIN RX->TX after it");
+  unsigned long worstForwardUs = 0;
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+  {
+    if (i > bootPhase)
+    {
+      Serial.printf("%-14s: pending\n", BOOT_PHASE_NAMES[i]);
+      continue;
+    }
+    if (bootWorstForwardUs[i] > 0)
+      Serial.printf("%-14s: %8lu us  %8lu us\n", BOOT_PHASE_NAMES[i], bootTimeUs[i], bootWorstForwardUs[i]);
+    else
+      Serial.printf("%-14s: %8lu us\n", BOOT_PHASE_NAMES[i], bootTimeUs[i]);
+    worstForwardUs = max(worstForwardUs, bootWorstForwardUs[i]);
+  }
+
+  if (firstMidiRxUs != 0)
+    Serial.printf("First MIDI RX : %8lu us\n", firstMidiRxUs);
+  if (firstMidiTxUs != 0)
+    Serial.printf("First MIDI TX : %8lu us (%lu us after RX)\n", firstMidiTxUs, firstMidiTxUs - firstMidiRxUs);
+
+  bool pass = bootTimeUs[BOOT_MIDI_LIVE] <= BOOT_MIDI_LIVE_TARGET_US;
+  Serial.printf("MIDI live target <= %lu us: %s\n", BOOT_MIDI_LIVE_TARGET_US, pass ? "✓ PASS" : "✗ FAIL");
+  if (firstMidiTxUs == 0 || firstMidiTxUs > bootTimeUs[BOOT_READY])
+    Serial.printf("Boot forward target <= %lu us: not tested (no DIN input while booting)\n", BOOT_FORWARD_TARGET_US);
+  else
+    Serial.printf("Boot forward target <= %lu us: %s\n", BOOT_FORWARD_TARGET_US,
+                  worstForwardUs <= BOOT_FORWARD_TARGET_US ? "✓ PASS" : "✗ FAIL");
+  Serial.println("===================\n");
+}
+
+// Function to format the input of a mapping slot ("CC74", "PC5", "Note C4")
+String slotName(int slot)
+{
+  int number = slot % MAP_NUMBERS;
+  switch (slot / MAP_NUMBERS)
+  {
+  case MSG_CC:
+    return "CC" + String(number);
+  case MSG_PC:
+    return "PC" + String(number);
+  default:
+    return "Note " + String(NOTE_NAMES[number]);
+  }
+}
+
+// Function to print the busiest mapping slots and the mapped slots that never fired
+void printSlotReport(int topCount)
+{
+  const int MAX_TOP = 32;
+  int top[MAX_TOP];
+  topCount = constrain(topCount, 1, MAX_TOP);
+  int count = slotCounters.top(top, topCount);
+
+  uint32_t now = millis();
+  uint32_t totalHits = 0, totalBytes = 0;
+  for (int s = 0; s < MAP_SLOTS; s++)
+  {
+    totalHits += slotCounters[s].hits;
+    totalBytes += slotCounters[s].bytes;
+  }
+
+  Serial.printf("\n=== Slot Profile (%lu s) ===\n", (unsigned long)((now - slotCounters.since()) / 1000));
+  Serial.printf("Inputs: %lu, bytes out: %lu\n", (unsigned long)totalHits, (unsigned long)totalBytes);
+  Serial.println(" #  Input      Kind    Hits  Outputs    Bytes  Wire%  Last hit");
+  for (int i = 0; i < count; i++)
+  {
+    const SlotStats &st = slotCounters[top[i]];
+    const char *kind = activeMapping.slots[top[i]].kind == SLOT_UNMAPPED ? "thru" : "map";
+    uint32_t wirePermille = totalBytes ? (uint64_t)st.bytes * 1000 / totalBytes : 0;
+    Serial.printf("%2d  %-9s  %-4s %7lu  %7lu  %7lu  %3lu.%lu  %lu ms ago\n", i + 1, slotName(top[i]).c_str(), kind,
+                  (unsigned long)st.hits, (unsigned long)st.outputs, (unsigned long)st.bytes,
+                  (unsigned long)(wirePermille / 10), (unsigned long)(wirePermille % 10),
+                  (unsigned long)(now - st.lastHitMs));
+  }
+  if (count == 0)
+    Serial.println("  (no input yet)");
+
+  // Mapped entries that never fired are candidates for removal
+  int idle = 0;
+  for (int s = 0; s < MAP_SLOTS; s++)
+  {
+    if (activeMapping.slots[s].kind == SLOT_UNMAPPED || slotCounters[s].hits > 0)
+      continue;
+    Serial.print(idle++ == 0 ? "Never fired: " : ", ");
+    Serial.print(slotName(s));
+  }
+  if (idle > 0)
+    Serial.printf(" (%d)\n", idle);
+  Serial.println("============================\n");
+}
+
+// Function to print the CPU time split of the last profiler window
+void printCpuReport()
+{
+  LoopProfiler::Window w;
+  if (!profiler.lastWindow(w))
+  {
+    Serial.println("✗ No complete profile window yet, try again in a second");
+    return;
+  }
+
+  uint32_t load = LoopProfiler::loadPermille(w);
+  uint32_t avg, peak;
+  profiler.historyLoad(avg, peak);
+
+  Serial.printf("\n=== CPU Profile (%lu ms windows) ===\n", (unsigned long)PROFILE_WINDOW_MS);
+  Serial.printf("CPU load       : %lu.%lu%% (avg %lu.%lu%%, peak %lu.%lu%% over %d windows)\n",
+                (unsigned long)(load / 10), (unsigned long)(load % 10), (unsigned long)(avg / 10), (unsigned long)(avg % 10),
+                (unsigned long)(peak / 10), (unsigned long)(peak % 10), PROFILE_HISTORY);
+  Serial.printf("Loop period    : worst %lu us (%lu us since reset), %lu loops/window\n",
+                (unsigned long)profiler.toUs(w.worstLoopCycles), (unsigned long)profiler.worstLoopEverUs(),
+                (unsigned long)w.loops);
+  Serial.println("Stage           Share   us/window");
+  for (int s = 0; s < STAGE_COUNT; s++)
+  {
+    uint32_t share = w.total ? (uint64_t)w.cycles[s] * 1000 / w.total : 0;
+    Serial.printf("%-14s %3lu.%lu%%  %9lu\n", PROFILE_STAGE_NAMES[s], (unsigned long)(share / 10),
+                  (unsigned long)(share % 10), (unsigned long)profiler.toUs(w.cycles[s]));
+  }
+  Serial.println("==================================\n");
+}
+
+// Function to draw the CPU load meter at the bottom of the IN side
+void drawCpuMeter()
+{
+  LoopProfiler::Window w;
+  if (!profiler.lastWindow(w))
+    return;
+
+  uint32_t load = LoopProfiler::loadPermille(w);
+  int width = load * 100 / 1000;
+  uint16_t color = load < 500 ? TFT_DARKGREEN : (load < 800 ? TFT_YELLOW : TFT_RED);
+
+  tft.drawRect(20, 150, 102, 8, TFT_DARKGREY);
+  tft.fillRect(21, 151, width, 6, color);
+  tft.fillRect(21 + width, 151, 100 - width, 6, TFT_BLACK);
+
+  tft.setTextSize(1);
+  tft.setTextColor(TFT_DARKGREY, TFT_BLACK);
+  tft.setCursor(126, 150);
+  tft.printf("%3lu%%", (unsigned long)((load + 5) / 10));
+}
+
+// Function to clear the CPU load meter
+void clearCpuMeter()
+{
+  tft.fillRect(20, 150, 132, 8, TFT_BLACK);
+}
+
+// Function to bring up the display in its own task
+// It runs below the loop task, so it only gets the CPU while loop() waits
+// for the next tick: MIDI is serviced at least every tick however long the
+// controller init and the first full-screen draw take.
+void displayInitTask(void *)
+{
+  tft.init();
+  markBootPhase(BOOT_DISPLAY_INIT);
+  drawStaticUI();
+  markBootPhase(BOOT_UI_DRAWN);
+  vTaskDelete(NULL);
+}
+
+// Function to run the next slow boot step
+// Called from loop() so MIDI is serviced between steps
+void continueBoot()
+{
+  switch (bootPhase)
+  {
+  case BOOT_SERIAL:
+  case BOOT_DISPLAY_INIT:
+    if (!displayInitStarted)
+    {
+      displayInitStarted = true;
+      if (xTaskCreate(displayInitTask, "displayInit", DISPLAY_INIT_STACK_SIZE, NULL, DISPLAY_INIT_PRIORITY, NULL) != pdPASS)
+      {
+        // No memory for the task: bring the display up here, blocking MIDI meanwhile
+        tft.init();
+        markBootPhase(BOOT_DISPLAY_INIT);
+        drawStaticUI();
+        markBootPhase(BOOT_UI_DRAWN);
+        break;
+      }
+    }
+    vTaskDelay(1); // Give the display task the rest of this tick
+    break;
+
+  case BOOT_UI_DRAWN:
+    // Initial display update
+    updateDisplay();
+    displayPending = false;
+    markBootPhase(BOOT_READY);
+
+    Serial.println("ESP32-C3 MIDI Mapper");
+    Serial.println("MIDI Serial1 on TX:GPIO6, RX:GPIO7");
+    Serial.println("Display initialized with MIDI data!");
+    printBootReport();
+    Serial.println("=== MIDI Mapper Ready ===");
+    Serial.println("Type 'help' for commands");
+    Serial.println("Demo mode: " + String(demoEnabled ? "ENABLED" : "DISABLED"));
+    if (demoEnabled)
+      startLoad(LOAD_DEMO, DEMO_RATE, 0);
+    Serial.println("========================\n");
+    break;
+
+  default:
+    break;
+  }
+}
+
+void setup()
+{
+  markBootPhase(BOOT_SETUP);
+  memset(heldNoteZones, ZONE_NONE, sizeof(heldNoteZones));
 
-  // Initial display update
-  updateDisplay();
+  // MIDI first: the thru path must be live before anything slow runs.
+  // The default mapping is compiled into flash, so nothing needs loading.
+  Serial1.setRxBufferSize(MIDI_RX_BUFFER_SIZE);
+  Serial1.begin(31250, SERIAL_8N1, MIDI_RX_PIN, MIDI_TX_PIN);
+  markBootPhase(BOOT_MIDI_LIVE);
+  lastMidiPollUs = bootTimeUs[BOOT_MIDI_LIVE];
 
-  // Load default mapping
-  loadMapping(defaultMapping);
+  Serial.begin(115200);
+  markBootPhase(BOOT_SERIAL);
 
-  Serial.println("Display initialized with MIDI data!");
-  Serial.println("\n=== MIDI Mapper Ready ===");
-  Serial.println("Type 'help' for commands");
-  Serial.println("Demo mode: " + String(demoEnabled ? "ENABLED" : "DISABLED"));
-  Serial.println("========================\n");
+  // Display and UI are brought up by a background task started from loop()
 }
 
 // Serial command parser
@@ -542,6 +955,9 @@ void setup()
 // Examples: cc_12_64, pc_5, nn_60_100
 void parseSerialCommand()
 {
+  if (receivePatchFrame())
+    return;
+
   if (Serial.available() > 0)
   {
     String cmd = Serial.readStringUntil('\n');
@@ -571,50 +987,7 @@ void parseSerialCommand()
 
         if (ccNum >= 0 && ccNum <= 127 && ccVal >= 0 && ccVal <= 127)
         {
-          currentMidi.type = MSG_CC;
-          currentMidi.inNumber = ccNum;
-          currentMidi.inValue = ccVal;
-
-          // Apply mapping
-          MappedOutput outputs[10];
-          int outputCount = 0;
-          applyMapping(currentMidi, outputs, outputCount);
-
-          // Display first output (for multi-output, show the first one)
-          if (outputCount > 0)
-          {
-            currentMidi.type = outputs[0].type; // Update type in case it changed
-            currentMidi.outNumber = outputs[0].number;
-            currentMidi.outValue = outputs[0].value;
-          }
-          else
-          {
-            currentMidi.outNumber = ccNum;
-            currentMidi.outValue = ccVal;
-          }
-
-          updateDisplay();
-          Serial.printf("✓ CC%d Value:%d -> ", ccNum, ccVal);
-
-          // Print all outputs with their types
-          for (int i = 0; i < outputCount; i++)
-          {
-            switch (outputs[i].type)
-            {
-            case MSG_CC:
-              Serial.printf("CC%d:%d", outputs[i].number, outputs[i].value);
-              break;
-            case MSG_PC:
-              Serial.printf("PC%d", outputs[i].number);
-              break;
-            case MSG_NOTE:
-              Serial.printf("Note %s:%d", NOTE_NAMES[outputs[i].number], outputs[i].value);
-              break;
-            }
-            if (i < outputCount - 1)
-              Serial.print(", ");
-          }
-          Serial.println();
+          injectHostMessage(0xB0, ccNum, ccVal, 3);
         }
         else
         {
@@ -636,49 +1009,7 @@ void parseSerialCommand()
 
       if (pcNum >= 0 && pcNum <= 127)
       {
-        currentMidi.type = MSG_PC;
-        currentMidi.inNumber = pcNum;
-        currentMidi.inValue = 0;
-
-        // Apply mapping
-        MappedOutput outputs[10];
-        int outputCount = 0;
-        applyMapping(currentMidi, outputs, outputCount);
-
-        // Display first output
-        if (outputCount > 0)
-        {
-          currentMidi.type = outputs[0].type; // Update type in case it changed
-          currentMidi.outNumber = outputs[0].number;
-          currentMidi.outValue = outputs[0].value;
-        }
-        else
-        {
-          currentMidi.outNumber = pcNum;
-        }
-
-        updateDisplay();
-        Serial.printf("✓ PC%d -> ", pcNum);
-
-        // Print all outputs with their types
-        for (int i = 0; i < outputCount; i++)
-        {
-          switch (outputs[i].type)
-          {
-          case MSG_CC:
-            Serial.printf("CC%d:%d", outputs[i].number, outputs[i].value);
-            break;
-          case MSG_PC:
-            Serial.printf("PC%d", outputs[i].number);
-            break;
-          case MSG_NOTE:
-            Serial.printf("Note %s:%d", NOTE_NAMES[outputs[i].number], outputs[i].value);
-            break;
-          }
-          if (i < outputCount - 1)
-            Serial.print(", ");
-        }
-        Serial.println();
+        injectHostMessage(0xC0, pcNum, 0, 2);
       }
       else
       {
@@ -701,50 +1032,7 @@ void parseSerialCommand()
 
         if (noteNum >= 0 && noteNum <= 127 && noteVel >= 0 && noteVel <= 127)
         {
-          currentMidi.type = MSG_NOTE;
-          currentMidi.inNumber = noteNum;
-          currentMidi.inValue = noteVel;
-
-          // Apply mapping
-          MappedOutput outputs[10];
-          int outputCount = 0;
-          applyMapping(currentMidi, outputs, outputCount);
-
-          // Display first output
-          if (outputCount > 0)
-          {
-            currentMidi.type = outputs[0].type; // Update type in case it changed
-            currentMidi.outNumber = outputs[0].number;
-            currentMidi.outValue = outputs[0].value;
-          }
-          else
-          {
-            currentMidi.outNumber = noteNum;
-            currentMidi.outValue = noteVel;
-          }
-
-          updateDisplay();
-          Serial.printf("✓ Note %s Vel:%d -> ", NOTE_NAMES[noteNum], noteVel);
-
-          // Print all outputs with their types
-          for (int i = 0; i < outputCount; i++)
-          {
-            switch (outputs[i].type)
-            {
-            case MSG_CC:
-              Serial.printf("CC%d:%d", outputs[i].number, outputs[i].value);
-              break;
-            case MSG_PC:
-              Serial.printf("PC%d", outputs[i].number);
-              break;
-            case MSG_NOTE:
-              Serial.printf("%s:%d", NOTE_NAMES[outputs[i].number], outputs[i].value);
-              break;
-            }
-            if (i < outputCount - 1)
-              Serial.print(", ");
-          }
-          Serial.println();
+          injectHostMessage(0x90, noteNum, noteVel, 3);
         }
         else
         {
@@ -756,16 +1044,77 @@ void parseSerialCommand()
         Serial.println("✗ Error: Format should be nn_<number>_<velocity>");
       }
     }
+    else if (cmd.startsWith("midi "))
+    {
+      // Raw MIDI bytes in hex: midi <byte> <byte> ...
+      // Parsed with the USB source's own running status, like a MIDI cable
+      const char *p = cmd.c_str() + 5;
+      char *end;
+      int count = 0;
+      while (true)
+      {
+        long b = strtol(p, &end, 16);
+        if (end == p || b < 0 || b > 0xFF)
+          break;
+        midiMerger.feed(SRC_USB, (uint8_t)b, micros());
+        count++;
+        p = end;
+      }
+      if (count == 0)
+        Serial.println("✗ Error: Format should be midi <hex byte> ... (e.g., midi 90 3c 64)");
+    }
+    else if (cmd.startsWith("bench"))
+    {
+      // bench merge [messages] | bench fanout [inputs] | bench patch [patches] | bench thin
+      int firstSpace = cmd.indexOf(' ');
+      String what = firstSpace > 0 ? cmd.substring(firstSpace + 1) : "";
+      int secondSpace = what.indexOf(' ');
+      long count = secondSpace > 0 ? what.substring(secondSpace + 1).toInt() : 0;
+      if (secondSpace > 0)
+        what = what.substring(0, secondSpace);
+
+      if (what == "merge")
+        benchMerge(count > 0 ? count : 20000);
+      else if (what == "fanout")
+        benchFanout(count > 0 ? count : 10000, 32);
+      else if (what == "patch")
+        benchPatch(count > 0 ? count : 2000);
+      else if (what == "thin")
+        benchThin();
+      else
+        Serial.println("✗ Error: Format should be bench merge|fanout|patch|thin [count]");
+    }
     else if (cmd == "help" || cmd == "?")
     {
       Serial.println("\n=== MIDI Mapper Commands ===");
       Serial.println("cc_<num>_<val>  - Control Change (e.g., cc_12_64)");
       Serial.println("pc_<num>        - Program Change (e.g., pc_5)");
       Serial.println("nn_<num>_<vel>  - Note (e.g., nn_60_100)");
+      Serial.println("midi <hex> ...  - Raw MIDI bytes (e.g., midi 90 3c 64)");
       Serial.println("map             - Toggle mapping on/off");
       Serial.println("showmap         - Show current mappings");
       Serial.println("loadmap         - Load default mapping");
       Serial.println("demo            - Toggle demo mode");
+      Serial.println("load <p> [r] [s]- Generate pattern p (sweep, chords, pc, mixed, demo)");
+      Serial.println("                  at r msg/s for s seconds");
+      Serial.println("load stop       - Stop the load generator");
+      Serial.println("boot            - Show boot phase timing");
+      Serial.println("sched           - Show scheduled output queue");
+      Serial.println("thin            - Show CC outputs dropped by \"dedupe\"");
+      Serial.println("log [level]     - Show log status or set level (off, error, info, debug)");
+      Serial.println("log text|raw    - Print log records as text or binary frames");
+      Serial.println("thin reset      - Reset the dedupe counters");
+      Serial.println("sources         - Show per-source input counters");
+      Serial.println("cpu             - Show CPU load per loop stage");
+      Serial.println("cpu reset       - Reset the CPU profile");
+      Serial.println("cpu meter       - Toggle the CPU meter on the display");
+      Serial.println("stats [n]       - Show the n busiest mapping slots");
+      Serial.println("stats reset     - Reset the slot counters");
+      Serial.println("fuzz [n] [seed] - Check compiled mapping against the reference");
+      Serial.println("bench merge [n] - Benchmark the DIN/USB merger");
+      Serial.println("bench fanout [n]- Benchmark 1->32 fan-out mapping");
+      Serial.println("bench patch [n] - Check n random patches against a full recompile");
+      Serial.println("bench thin      - Bytes saved by \"dedupe\" on a knob-sweep trace");
       Serial.println("help or ?       - Show this help");
       Serial.println("===========================\n");
     }
@@ -783,9 +1132,13 @@ void parseSerialCommand()
     }
     else if (cmd == "showmap")
     {
-      if (mapDoc.isNull() || mapDoc.size() == 0)
+      if (userMapping == nullptr)
       {
-        Serial.println("✗ No mapping loaded. Use 'loadmap' to load default mapping.");
+        JsonDocument defaultDoc;
+        defaultMappingDocument(defaultDoc);
+        Serial.println("\n=== Built-in Default Mapping ===");
+        serializeJsonPretty(defaultDoc, Serial);
+        Serial.println("\n===========================\n");
       }
       else
       {
@@ -796,20 +1149,180 @@ void parseSerialCommand()
     }
     else if (cmd == "loadmap")
     {
-      loadMapping(defaultMapping);
+      useDefaultMapping();
+    }
+    else if (cmd == "boot")
+    {
+      printBootReport();
+    }
+    else if (cmd == "sources")
+    {
+      Serial.printf("DIN: %lu messages, %lu dropped\n", (unsigned long)midiMerger.received(SRC_DIN), (unsigned long)midiMerger.dropped(SRC_DIN));
+      Serial.printf("USB: %lu messages, %lu dropped\n", (unsigned long)midiMerger.received(SRC_USB), (unsigned long)midiMerger.dropped(SRC_USB));
+      Serial.printf("GEN: %lu messages, %lu dropped\n", (unsigned long)midiMerger.received(SRC_GEN), (unsigned long)midiMerger.dropped(SRC_GEN));
+      Serial.printf("SysEx timeouts: %lu (a source went quiet inside a SysEx)\n", (unsigned long)midiMerger.sysexTimeouts());
+    }
+    else if (cmd.startsWith("stats"))
+    {
+      // stats [n] | stats reset
+      String arg = cmd.substring(5);
+      arg.trim();
+      if (arg == "reset")
+      {
+        slotCounters.reset(millis());
+        Serial.println("✓ Slot counters reset");
+      }
+      else
+      {
+        printSlotReport(arg.length() > 0 ? arg.toInt() : 10);
+      }
+    }
+    else if (cmd == "fuzz" || cmd.startsWith("fuzz "))
+    {
+      // fuzz [documents] [seed]
+      String args = cmd.substring(4);
+      args.trim();
+      int space = args.indexOf(' ');
+      long docs = args.length() > 0 ? args.toInt() : 500;
+      long seed = space > 0 ? args.substring(space + 1).toInt() : (long)((micros() & 0x7FFFFFFF) | 1);
+      if (docs > 0)
+        runMappingFuzz(docs, seed);
+      else
+        Serial.println("✗ Error: Format should be fuzz [documents] [seed]");
+    }
+    else if (cmd.startsWith("cpu"))
+    {
+      // cpu | cpu reset | cpu meter
+      String arg = cmd.substring(3);
+      arg.trim();
+      if (arg == "reset")
+      {
+        profiler.reset();
+        Serial.println("✓ CPU profile reset");
+      }
+      else if (arg == "meter")
+      {
+        cpuMeterEnabled = !cpuMeterEnabled;
+        if (!cpuMeterEnabled)
+          clearCpuMeter();
+        cpuMeterDrawnWindow = 0;
+        Serial.println(cpuMeterEnabled ? "✓ CPU meter ON" : "✓ CPU meter OFF");
+      }
+      else
+      {
+        printCpuReport();
+      }
+    }
+    else if (cmd.startsWith("thin"))
+    {
+      // thin | thin reset
+      String arg = cmd.substring(4);
+      arg.trim();
+      if (arg == "reset")
+      {
+        thinner.resetStats();
+        Serial.println("✓ Dedupe counters reset");
+      }
+      else
+      {
+        uint32_t unchanged = thinner.dropped(OutputThinner::DROP_UNCHANGED);
+        uint32_t deadband = thinner.dropped(OutputThinner::DROP_DEADBAND);
+        uint32_t rate = thinner.dropped(OutputThinner::DROP_RATE);
+        uint32_t flushed = thinner.flushes();
+        uint32_t dropped = unchanged + deadband + rate;
+        Serial.printf("Dropped CC outputs: %lu unchanged, %lu deadband, %lu rate limit\n",
+                      (unsigned long)unchanged, (unsigned long)deadband, (unsigned long)rate);
+        Serial.printf("Final values flushed: %lu (%d pending)\n", (unsigned long)flushed, thinner.pendingFlushes());
+        Serial.printf("MIDI bytes saved: %lu\n", (unsigned long)(dropped > flushed ? (dropped - flushed) * 3 : 0));
+      }
+    }
+    else if (cmd == "log" || cmd.startsWith("log "))
+    {
+      // log | log off|error|info|debug | log text|raw
+      String arg = cmd.substring(3);
+      arg.trim();
+      bool known = arg.length() == 0;
+      for (int l = 0; l < LOG_LEVEL_COUNT; l++)
+      {
+        if (arg == LOG_LEVEL_NAMES[l])
+        {
+          eventLog.setLevel((LogLevel)l);
+          known = true;
+        }
+      }
+      if (arg == "text" || arg == "raw")
+      {
+        logRaw = arg == "raw";
+        known = true;
+      }
+
+      if (known)
+        Serial.printf("Log: %s, %s, %lu records, %lu dropped, %u pending (ring %u)\n", LOG_LEVEL_NAMES[eventLog.level()],
+                      logRaw ? "raw" : "text", (unsigned long)eventLog.records(), (unsigned long)eventLog.drops(),
+                      (unsigned)eventLog.pending(), (unsigned)LOG_RING_SIZE);
+      else
+        Serial.println("✗ Error: Format should be log [off|error|info|debug|text|raw]");
+    }
+    else if (cmd == "sched")
+    {
+      Serial.printf("Scheduled outputs: %u pending, %u dropped (capacity %u)\n",
+                    (unsigned)outputQueue.pending(), (unsigned)outputQueue.drops(), (unsigned)WHEEL_CAPACITY);
+      Serial.printf("Stale note offs  : %lu skipped (note struck again before its gate ended)\n",
+                    (unsigned long)staleNoteOffs);
     }
     else if (cmd == "demo")
     {
       demoEnabled = !demoEnabled;
       if (demoEnabled)
       {
-        Serial.println("✓ Demo mode ENABLED - auto-cycling through MIDI messages");
+        startLoad(LOAD_DEMO, DEMO_RATE, 0);
+        Serial.println("✓ Demo mode ENABLED - mixed MIDI traffic through the mapping");
       }
       else
       {
+        loadGen.stop(micros());
         Serial.println("✓ Demo mode DISABLED - use serial commands");
       }
     }
+    else if (cmd == "load" || cmd.startsWith("load "))
+    {
+      // load <pattern> [rate] [seconds] | load stop
+      String args = cmd.substring(4);
+      args.trim();
+      int space = args.indexOf(' ');
+      String what = space > 0 ? args.substring(0, space) : args;
+      String rest = space > 0 ? args.substring(space + 1) : "";
+      rest.trim();
+      space = rest.indexOf(' ');
+      long rate = rest.length() > 0 ? rest.toInt() : 1000;
+      long seconds = space > 0 ? rest.substring(space + 1).toInt() : 10;
+
+      int pattern = 0;
+      while (pattern < LOAD_PATTERN_COUNT && what != LOAD_PATTERN_NAMES[pattern])
+        pattern++;
+
+      if (what == "stop")
+      {
+        bool wasDemo = demoEnabled;
+        demoEnabled = false;
+        if (loadGen.running())
+        {
+          loadGen.stop(micros());
+          if (!wasDemo)
+            loadGen.printReport(midiBytesOut - loadStartBytesOut);
+        }
+      }
+      else if (pattern < LOAD_PATTERN_COUNT && rate > 0 && rate <= 100000 && seconds > 0 && seconds <= 3600)
+      {
+        demoEnabled = false;
+        startLoad((LoadPattern)pattern, rate, seconds * 1000);
+        Serial.printf("✓ Load: %s @ %ld msg/s for %ld s\n", LOAD_PATTERN_NAMES[pattern], rate, seconds);
+      }
+      else
+      {
+        Serial.println("✗ Error: Format should be load sweep|chords|pc|mixed [rate 1-100000] [seconds 1-3600] or load stop");
+      }
+    }
     else
     {
       Serial.println("✗ Unknown command. Type 'help' for command list");
@@ -819,74 +1332,72 @@ void parseSerialCommand()
 
 void loop()
 {
-  // Check for serial commands
-  parseSerialCommand();
-
-  // Update LED state (turn off after duration)
-  updateLED();
-
-  // Demo: Cycle through different MIDI message types every 1 second (if enabled)
-  static unsigned long lastUpdate = 0;
-  static uint8_t demoMode = 0;
+  profiler.loopStart();
 
-  if (demoEnabled && millis() - lastUpdate > 1000)
+  // MIDI thru has priority over everything else
   {
-    lastUpdate = millis();
-
-    // Cycle through different demo scenarios
-    switch (demoMode)
-    {
-    case 0: // CC example
-      currentMidi.type = MSG_CC;
-      currentMidi.inNumber = 12;
-      currentMidi.inValue = random(0, 128);
-      currentMidi.outNumber = 16;
-      currentMidi.outValue = random(0, 128);
-      Serial.println("Demo: CC12 -> CC16");
-      break;
-
-    case 1: // Different CC
-      currentMidi.type = MSG_CC;
-      currentMidi.inNumber = 74;
-      currentMidi.inValue = random(0, 128);
-      currentMidi.outNumber = 71;
-      currentMidi.outValue = random(0, 128);
-      Serial.println("Demo: CC74 -> CC71");
-      break;
-
-    case 2: // Program Change
-      currentMidi.type = MSG_PC;
-      currentMidi.inNumber = random(0, 128);
-      currentMidi.outNumber = random(0, 128);
-      Serial.println("Demo: PC -> PC");
-      break;
+    StageScope stage(profiler, STAGE_LOAD_GEN);
+    stage.worked = loadGen.running();
+    serviceLoadGenerator();
+  }
+  {
+    StageScope stage(profiler, STAGE_MIDI_IN);
+    stage.worked = processMidiInput() > 0;
+  }
+  {
+    StageScope stage(profiler, STAGE_TIMERS);
+    stage.worked = outputQueue.pending() > 0 || thinner.pendingFlushes() > 0;
+    serviceOutputQueue();
+  }
 
-    case 3: // Note example
-      currentMidi.type = MSG_NOTE;
-      currentMidi.inNumber = 60; // Middle C
-      currentMidi.inValue = random(60, 127);
-      currentMidi.outNumber = 64; // E
-      currentMidi.outValue = random(60, 127);
-      Serial.println("Demo: Note C4 -> E4");
-      break;
+  if (bootPhase != BOOT_READY)
+  {
+    StageScope stage(profiler, STAGE_DISPLAY);
+    continueBoot();
+    return;
+  }
 
-    case 4: // Another note
-      currentMidi.type = MSG_NOTE;
-      currentMidi.inNumber = 72; // C5
-      currentMidi.inValue = random(60, 127);
-      currentMidi.outNumber = 76; // E5
-      currentMidi.outValue = random(60, 127);
-      Serial.println("Demo: Note C5 -> E5");
-      break;
-    }
+  // Check for serial commands
+  {
+    StageScope stage(profiler, STAGE_COMMANDS);
+    stage.worked = Serial.available() > 0;
+    parseSerialCommand();
+  }
 
-    // Update display with new data
+  // Show the latest MIDI input, rate limited so drawing never starves MIDI
+  if (displayPending && millis() - lastMidiDisplay >= MIDI_DISPLAY_INTERVAL)
+  {
+    StageScope stage(profiler, STAGE_DISPLAY);
+    lastMidiDisplay = millis();
+    displayPending = false;
     updateDisplay();
+  }
+
+  // Refresh the CPU meter once per profiler window
+  if (cpuMeterEnabled && profiler.windows() != cpuMeterDrawnWindow)
+  {
+    StageScope stage(profiler, STAGE_DISPLAY);
+    cpuMeterDrawnWindow = profiler.windows();
+    drawCpuMeter();
+  }
 
-    // Cycle to next demo mode
-    demoMode = (demoMode + 1) % 5;
+  // Update LED state (turn off after duration)
+  {
+    StageScope stage(profiler, STAGE_LED);
+    stage.worked = ledState;
+    updateLED();
   }
 
   // Parse any serial commands
-  parseSerialCommand();
+  {
+    StageScope stage(profiler, STAGE_COMMANDS);
+    stage.worked = Serial.available() > 0;
+    parseSerialCommand();
+  }
+
+  // Print logged MIDI events last, with whatever time is left
+  {
+    StageScope stage(profiler, STAGE_LOG);
+    stage.worked = drainEventLog();
+  }
 }
\ No newline at end of file
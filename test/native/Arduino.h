@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+
+// Minimal Arduino core for the native tests ('pio test -e native')
+//
+// Only what the mapping code in src/ uses: String and constrain(). ArduinoJson
+// picks this header up through ARDUINOJSON_ENABLE_ARDUINO_STRING, so String
+// values read from and written to documents behave as on the device.
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class String
+{
+public:
+  String() {}
+  String(const char *s) { assign(s); }
+  String(char c) : text(1, c) {}
+  String(int n) : text(std::to_string(n)) {}
+  String(unsigned int n) : text(std::to_string(n)) {}
+  String(long n) : text(std::to_string(n)) {}
+  String(unsigned long n) : text(std::to_string(n)) {}
+  String(unsigned char n) : text(std::to_string(n)) {}
+
+  String &operator=(const char *s)
+  {
+    assign(s);
+    return *this;
+  }
+
+  const char *c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.size(); }
+  char operator[](unsigned int index) const { return index < text.size() ? text[index] : 0; }
+
+  // Function to append a C string; returns false on a null pointer like the core
+  bool concat(const char *s)
+  {
+    if (!s)
+      return false;
+    text += s;
+    return true;
+  }
+  bool concat(const String &s)
+  {
+    text += s.text;
+    return true;
+  }
+  bool concat(char c)
+  {
+    text += c;
+    return true;
+  }
+
+  String &operator+=(const String &s)
+  {
+    text += s.text;
+    return *this;
+  }
+  String &operator+=(const char *s)
+  {
+    concat(s);
+    return *this;
+  }
+  String &operator+=(char c)
+  {
+    text += c;
+    return *this;
+  }
+
+  bool operator==(const String &s) const { return text == s.text; }
+  bool operator==(const char *s) const { return text == (s ? s : ""); }
+  bool operator!=(const String &s) const { return text != s.text; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+
+  int indexOf(char c) const
+  {
+    size_t pos = text.find(c);
+    return pos == std::string::npos ? -1 : (int)pos;
+  }
+
+  String substring(unsigned int from) const { return substring(from, text.size()); }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    if (from > to)
+      std::swap(from, to);
+    if (from >= text.size())
+      return String();
+    String s;
+    s.text = text.substr(from, to - from);
+    return s;
+  }
+
+  long toInt() const { return atol(text.c_str()); }
+
+  void toLowerCase()
+  {
+    for (char &c : text)
+      if (c >= 'A' && c <= 'Z')
+        c += 'a' - 'A';
+  }
+
+private:
+  // Function to copy a C string; a null pointer gives an empty string
+  void assign(const char *s) { text = s ? s : ""; }
+
+  std::string text;
+};
+
+inline String operator+(const String &a, const String &b)
+{
+  String s = a;
+  s += b;
+  return s;
+}
+
+inline String operator+(const String &a, const char *b)
+{
+  String s = a;
+  s += b;
+  return s;
+}
+
+inline String operator+(const char *a, const String &b)
+{
+  String s = a;
+  s += b;
+  return s;
+}
@@ -0,0 +1,95 @@
+#include <unity.h>
+#include <memory>
+#include "EventLog.h"
+
+// EventLog: levels, ring order, full ring, index wrap
+
+std::unique_ptr<EventLog> eventLog;
+
+void test_levels()
+{
+  eventLog->setLevel(LOG_ERROR);
+  TEST_ASSERT_TRUE(eventLog->enabled(LOG_ERROR));
+  TEST_ASSERT_FALSE(eventLog->enabled(LOG_INFO));
+  eventLog->setLevel(LOG_OFF);
+  TEST_ASSERT_FALSE(eventLog->enabled(LOG_ERROR));
+  eventLog->setLevel(LOG_DEBUG);
+  TEST_ASSERT_TRUE(eventLog->enabled(LOG_DEBUG));
+}
+
+void test_records_come_out_in_order()
+{
+  LogRecord record;
+  TEST_ASSERT_FALSE(eventLog->take(record));
+  eventLog->append(LOG_MIDI_IN, 1, 0, 7, 64, 100);
+  eventLog->append(LOG_MIDI_OUT, 1, 2, 60, 127, 101);
+  TEST_ASSERT_EQUAL_UINT16(2, eventLog->pending());
+
+  TEST_ASSERT_TRUE(eventLog->take(record));
+  TEST_ASSERT_EQUAL_UINT8(LOG_MIDI_IN, record.kind);
+  TEST_ASSERT_EQUAL_UINT8(7, record.number);
+  TEST_ASSERT_EQUAL_UINT8(64, record.value);
+  TEST_ASSERT_EQUAL_UINT32(100, record.timeUs);
+  TEST_ASSERT_TRUE(eventLog->take(record));
+  TEST_ASSERT_EQUAL_UINT8(LOG_MIDI_OUT, record.kind);
+  TEST_ASSERT_EQUAL_UINT8(2, record.type);
+  TEST_ASSERT_FALSE(eventLog->take(record));
+  TEST_ASSERT_EQUAL_UINT32(2, eventLog->records());
+}
+
+void test_full_ring_drops_new_records()
+{
+  for (uint16_t i = 0; i < LOG_RING_SIZE; i++)
+    TEST_ASSERT_TRUE(eventLog->append(LOG_FORWARD, 0, 0, 3, i & 0x7F, i));
+  TEST_ASSERT_FALSE(eventLog->append(LOG_FORWARD, 0, 0, 3, 0, 999));
+  TEST_ASSERT_EQUAL_UINT32(1, eventLog->drops());
+
+  // The oldest records are kept, the new one is lost
+  LogRecord record;
+  TEST_ASSERT_TRUE(eventLog->take(record));
+  TEST_ASSERT_EQUAL_UINT32(0, record.timeUs);
+  TEST_ASSERT_TRUE(eventLog->append(LOG_FORWARD, 0, 0, 3, 0, 1000));
+}
+
+// Appending and taking in bursts past the 16-bit index wrap loses nothing
+void test_indices_wrap()
+{
+  const uint32_t RECORDS = 200000;
+  uint32_t appended = 0, expected = 0;
+  bool inOrder = true;
+  LogRecord record;
+  while (expected < RECORDS)
+  {
+    uint32_t burst = 1 + appended % 97;
+    for (uint32_t i = 0; i < burst && appended < RECORDS; i++, appended++)
+      TEST_ASSERT_TRUE(eventLog->append(LOG_MIDI_IN, 0, 0, appended & 0x7F, 0, appended));
+    while (eventLog->take(record))
+    {
+      inOrder = inOrder && record.timeUs == expected && record.number == (expected & 0x7F);
+      expected++;
+    }
+  }
+  TEST_ASSERT_TRUE(inOrder);
+  TEST_ASSERT_EQUAL_UINT32(RECORDS, eventLog->records());
+  TEST_ASSERT_EQUAL_UINT32(0, eventLog->drops());
+}
+
+void setUp()
+{
+  eventLog.reset(new EventLog());
+}
+
+void tearDown()
+{
+  eventLog.reset();
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_levels);
+  RUN_TEST(test_records_come_out_in_order);
+  RUN_TEST(test_full_ring_drops_new_records);
+  RUN_TEST(test_indices_wrap);
+  return UNITY_END();
+}
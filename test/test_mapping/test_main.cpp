@@ -0,0 +1,164 @@
+#include <unity.h>
+#include <memory>
+#include <vector>
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "MappingCompiler.h"
+#include "MappingPatch.h"
+#include "MappingCheck.h"
+#include "DefaultMapping.h"
+
+// Mapping engine properties, the same ones the on-device checks test
+
+void test_default_json_matches_flash()
+{
+  TEST_ASSERT_EQUAL_UINT32(0, checkDefaultMapping());
+}
+
+// One CC driving many outputs: every output comes out, in order, scaled
+void test_fanout_emits_every_output()
+{
+  const int WIDTH = 200;
+  auto mapping = std::make_unique<RuntimeMapping>();
+  std::vector<ConditionalOutput> rules;
+  for (int i = 0; i < WIDTH; i++)
+  {
+    ConditionalOutput rule = simpleOutput(MSG_CC, (20 + i) & 0x7F, 0);
+    rule.out.scale = 0.5f + (float)i / WIDTH;
+    rules.push_back(rule);
+  }
+  TEST_ASSERT_TRUE(assembleSlot(rules, *mapping, mapping->slots[slotIndex(MSG_CC, 1)]));
+  MappingTable table = mapping->table();
+
+  for (int v = 0; v < 128; v++)
+  {
+    MidiData midi = {MSG_CC, 1, (uint8_t)v, 0, 0, SRC_DIN};
+    int index = 0;
+    bool inOrder = true;
+    bool mapped = mapMessage(table, midi, nullptr, [&](const MappedOutput &out)
+                             {
+                               inOrder = inOrder && out.number == ((20 + index) & 0x7F) &&
+                                         out.value == scaleValue(v, rules[index].out.scale);
+                               index++;
+                             });
+    TEST_ASSERT_TRUE(mapped);
+    TEST_ASSERT_EQUAL(WIDTH, index);
+    TEST_ASSERT_TRUE(inOrder);
+  }
+}
+
+// PC inputs have no value: their note outputs must not go out as note offs
+void test_pc_note_outputs_have_velocity()
+{
+  auto mapping = std::make_unique<RuntimeMapping>();
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, R"({"note_gate": 250,
+    "pc_map": {"5": "note:60", "6": {"type": "note", "num": 62, "value": 90}},
+    "cc_map": {"7": {"num": 8, "value": 127}}})"));
+  TEST_ASSERT_TRUE(compileMapping(doc, *mapping));
+  MappingTable table = mapping->table();
+
+  std::vector<MappedOutput> outputs;
+  auto collect = [&](const MappedOutput &out)
+  { outputs.push_back(out); };
+
+  mapMessage(table, {MSG_PC, 5, 0, 0, 0, SRC_DIN}, nullptr, collect);
+  mapMessage(table, {MSG_PC, 6, 0, 0, 0, SRC_DIN}, nullptr, collect);
+  mapMessage(table, {MSG_CC, 7, 3, 0, 0, SRC_DIN}, nullptr, collect);
+  TEST_ASSERT_EQUAL(3, outputs.size());
+  TEST_ASSERT_EQUAL_UINT8(PC_NOTE_VELOCITY, outputs[0].value);
+  TEST_ASSERT_EQUAL_UINT16(250, outputs[0].gateMs);
+  TEST_ASSERT_EQUAL_UINT8(90, outputs[1].value);
+  TEST_ASSERT_EQUAL_UINT8(127, outputs[2].value);
+
+  // The flash default plays its PC -> note output the same way
+  outputs.clear();
+  mapMessage(DEFAULT_MAPPING.table(), {MSG_PC, 5, 0, 0, 0, SRC_DIN}, nullptr, collect);
+  TEST_ASSERT_EQUAL(2, outputs.size());
+  TEST_ASSERT_EQUAL_UINT8(PC_NOTE_VELOCITY, outputs[1].value);
+}
+
+// Random set/rep/del patches, round-tripped through MessagePack like UI
+// patch frames, must leave the same tables as compiling the patched document
+void test_patches_match_recompile()
+{
+  const uint32_t PATCHES = 600;
+  auto patched = std::make_unique<RuntimeMapping>();
+  auto reference = std::make_unique<RuntimeMapping>();
+  JsonDocument doc;
+  TEST_ASSERT_TRUE(defaultMappingDocument(doc));
+  TEST_ASSERT_TRUE(compileMapping(doc, *patched));
+
+  uint32_t rng = 0x2468ACE1;
+  uint32_t results[5] = {0, 0, 0, 0, 0};
+  uint8_t frame[512];
+  for (uint32_t i = 1; i <= PATCHES; i++)
+  {
+    JsonDocument request;
+    randomPatch(request, rng);
+    size_t len = serializeMsgPack(request, frame, sizeof(frame));
+    JsonDocument patch;
+    TEST_ASSERT_FALSE(deserializeMsgPack(patch, frame, len));
+
+    PatchedRange changed;
+    PatchResult result = applyPatch(doc, *patched, patch.as<JsonVariant>(), changed);
+    results[result]++;
+
+    if (i % 50 == 0)
+    {
+      TEST_ASSERT_TRUE(compileMapping(doc, *reference));
+      TEST_ASSERT_EQUAL_UINT32(0, compareMappings(patched->table(), reference->table()));
+    }
+  }
+  // The generator must actually exercise successful and failed patches
+  TEST_ASSERT_TRUE(results[PATCH_OK] > PATCHES / 2);
+  TEST_ASSERT_TRUE(results[PATCH_NOT_FOUND] > 0);
+}
+
+// Random documents and MIDI streams: the compiled tables put the same
+// bytes on the wire as the reference interpreter, minus the targets outside
+// 0-127 it sent masked
+void test_reference_matches_compiled()
+{
+  const uint32_t SEEDS[] = {1, 0xC0FFEE, 0x5EED1234};
+  const uint32_t DOCS = 150;
+  auto compiled = std::make_unique<RuntimeMapping>();
+  JsonDocument doc;
+  std::vector<MappedOutput> outputs;
+  FuzzStats stats = {};
+  uint32_t rejected = 0;
+
+  for (uint32_t seed : SEEDS)
+  {
+    uint32_t rng = seed;
+    for (uint32_t d = 0; d < DOCS; d++)
+    {
+      fuzzDocument(doc, rng);
+      TEST_ASSERT_TRUE(compileMapping(doc, *compiled));
+      rejected += compiled->rejectedOutputs;
+      stats.docs++;
+      fuzzStream(doc, compiled->table(), rng, outputs, stats,
+                 [](const MidiData &, const MappedOutput *, int, bool, bool, bool) {});
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, stats.divergences);
+  // Targets outside 0-127 must come up, and the compiler must skip them
+  TEST_ASSERT_TRUE(stats.outOfRange > 0);
+  TEST_ASSERT_TRUE(rejected > 0);
+  TEST_ASSERT_TRUE(stats.mapped > 0);
+  TEST_ASSERT_TRUE(stats.outputs > 0);
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_default_json_matches_flash);
+  RUN_TEST(test_fanout_emits_every_output);
+  RUN_TEST(test_pc_note_outputs_have_velocity);
+  RUN_TEST(test_patches_match_recompile);
+  RUN_TEST(test_reference_matches_compiled);
+  return UNITY_END();
+}
@@ -0,0 +1,258 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "MidiMerger.h"
+#include "Xorshift.h"
+
+// MidiMerger: per-source parsing, timestamp order, full queues, SysEx
+// holding, throughput
+
+void test_sources_do_not_mix()
+{
+  MidiMerger merger;
+  // A DIN CC and a USB note, interleaved byte by byte
+  merger.feed(SRC_DIN, 0xB0, 1);
+  merger.feed(SRC_USB, 0x91, 2);
+  merger.feed(SRC_DIN, 0x07, 3);
+  merger.feed(SRC_USB, 0x3C, 4);
+  merger.feed(SRC_USB, 0x64, 5);
+  merger.feed(SRC_DIN, 0x40, 6);
+
+  MidiEvent ev;
+  TEST_ASSERT_TRUE(merger.pop(ev, 6));
+  TEST_ASSERT_EQUAL(SRC_USB, ev.source);
+  TEST_ASSERT_EQUAL_HEX8(0x91, ev.msg.bytes[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x3C, ev.msg.bytes[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x64, ev.msg.bytes[2]);
+  TEST_ASSERT_EQUAL_UINT32(5, ev.timeUs);
+
+  TEST_ASSERT_TRUE(merger.pop(ev, 6));
+  TEST_ASSERT_EQUAL(SRC_DIN, ev.source);
+  TEST_ASSERT_EQUAL_HEX8(0xB0, ev.msg.bytes[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x07, ev.msg.bytes[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x40, ev.msg.bytes[2]);
+  TEST_ASSERT_FALSE(merger.pop(ev, 6));
+}
+
+void test_pop_in_time_order_across_wrap()
+{
+  MidiMerger merger;
+  MidiMessage clock = {{0xF8, 0, 0}, 1};
+  merger.push(SRC_USB, clock, 0x00000010);
+  merger.push(SRC_DIN, clock, 0xFFFFFFF0); // Older, before micros() wrapped
+  merger.push(SRC_DIN, clock, 0x00000020);
+
+  MidiEvent ev;
+  TEST_ASSERT_TRUE(merger.pop(ev, 0x20));
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFF0, ev.timeUs);
+  TEST_ASSERT_TRUE(merger.pop(ev, 0x20));
+  TEST_ASSERT_EQUAL_UINT32(0x10, ev.timeUs);
+  TEST_ASSERT_TRUE(merger.pop(ev, 0x20));
+  TEST_ASSERT_EQUAL_UINT32(0x20, ev.timeUs);
+}
+
+void test_full_queue_drops_and_counts()
+{
+  MidiMerger merger;
+  MidiMessage clock = {{0xF8, 0, 0}, 1};
+  for (int i = 0; i < MERGER_QUEUE_SIZE; i++)
+    TEST_ASSERT_TRUE(merger.push(SRC_DIN, clock, i));
+  TEST_ASSERT_FALSE(merger.hasSpace(SRC_DIN));
+  TEST_ASSERT_TRUE(merger.hasSpace(SRC_USB));
+  TEST_ASSERT_FALSE(merger.feed(SRC_DIN, 0xF8, 100));
+  TEST_ASSERT_EQUAL_UINT32(MERGER_QUEUE_SIZE, merger.received(SRC_DIN));
+  TEST_ASSERT_EQUAL_UINT32(1, merger.dropped(SRC_DIN));
+
+  merger.reset();
+  MidiEvent ev;
+  TEST_ASSERT_FALSE(merger.pop(ev, 100));
+  TEST_ASSERT_TRUE(merger.hasSpace(SRC_DIN));
+}
+
+// Same property as 'bench merge': two running-status streams interleaved in
+// random order, with clock bytes inside messages, all come out whole and in order
+void test_interleaved_streams_stay_whole()
+{
+  const uint32_t MESSAGES = 5000;
+  const uint8_t STATUS[SRC_COUNT] = {0xB0, 0x92};
+  MidiMerger merger;
+  uint32_t sent[SRC_COUNT] = {0, 0};
+  uint8_t phase[SRC_COUNT] = {0, 0};
+  bool statusSent[SRC_COUNT] = {false, false};
+  uint32_t expected[SRC_COUNT] = {0, 0};
+  uint32_t clocks = 0, timeUs = 0, rng = 0x1234567;
+
+  while (sent[SRC_DIN] < MESSAGES || sent[SRC_USB] < MESSAGES || phase[SRC_DIN] || phase[SRC_USB])
+  {
+    MidiSource s = (MidiSource)(xorshift32(rng) & 1);
+    if (sent[s] >= MESSAGES && phase[s] == 0)
+      s = (MidiSource)(1 - s);
+
+    uint8_t b;
+    if (xorshift32(rng) % 7 == 0)
+    {
+      b = 0xF8;
+      clocks++;
+    }
+    else if (!statusSent[s])
+    {
+      b = STATUS[s];
+      statusSent[s] = true;
+    }
+    else if (phase[s] == 0)
+    {
+      b = sent[s] & 0x7F;
+      phase[s] = 1;
+    }
+    else
+    {
+      b = (sent[s]++ >> 7) & 0x7F;
+      phase[s] = 0;
+    }
+    TEST_ASSERT_TRUE(merger.feed(s, b, timeUs++));
+
+    MidiEvent ev;
+    while (merger.pop(ev, timeUs))
+    {
+      if (ev.msg.bytes[0] == 0xF8)
+      {
+        clocks--;
+        continue;
+      }
+      TEST_ASSERT_EQUAL_HEX8(STATUS[ev.source], ev.msg.bytes[0]);
+      uint32_t n = ev.msg.bytes[1] | (ev.msg.bytes[2] << 7);
+      TEST_ASSERT_EQUAL_UINT32(expected[ev.source] & 0x3FFF, n);
+      expected[ev.source]++;
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(MESSAGES, expected[SRC_DIN]);
+  TEST_ASSERT_EQUAL_UINT32(MESSAGES, expected[SRC_USB]);
+  TEST_ASSERT_EQUAL_UINT32(0, clocks);
+}
+
+// A SysEx from one source comes out whole: the other source's messages wait
+// for its F7, but its real-time bytes do not
+void test_sysex_holds_other_sources()
+{
+  MidiMerger merger;
+  const uint8_t SYSEX[] = {0xF0, 0x7E, 0x01, 0x02, 0x03, 0xF7};
+  uint32_t timeUs = 0;
+  for (uint8_t b : SYSEX)
+  {
+    merger.feed(SRC_DIN, b, timeUs++);
+    merger.feed(SRC_USB, 0xF8, timeUs++);
+    merger.feed(SRC_USB, 0x91, timeUs++);
+    merger.feed(SRC_USB, 0x3C, timeUs++);
+    merger.feed(SRC_USB, 0x64, timeUs++);
+  }
+
+  MidiEvent ev;
+  uint8_t sysex[sizeof(SYSEX)];
+  int sysexCount = 0, clocks = 0, notes = 0;
+  bool whole = true;
+  while (merger.pop(ev, timeUs))
+  {
+    if (ev.msg.bytes[0] == 0xF8)
+    {
+      clocks++;
+    }
+    else if (ev.source == SRC_DIN)
+    {
+      sysex[sysexCount++] = ev.msg.bytes[0];
+    }
+    else
+    {
+      notes++;
+      whole = whole && (sysexCount == 0 || sysexCount == sizeof(SYSEX));
+    }
+  }
+  TEST_ASSERT_TRUE(whole);
+  TEST_ASSERT_EQUAL(sizeof(SYSEX), sysexCount);
+  for (size_t i = 0; i < sizeof(SYSEX); i++)
+    TEST_ASSERT_EQUAL_HEX8(SYSEX[i], sysex[i]);
+  TEST_ASSERT_EQUAL(6, clocks);
+  TEST_ASSERT_EQUAL(6, notes);
+  TEST_ASSERT_EQUAL_UINT32(0, merger.sysexTimeouts());
+}
+
+// A SysEx that stops without F7 holds the other sources only until the timeout
+void test_sysex_timeout_releases_other_sources()
+{
+  MidiMerger merger;
+  merger.feed(SRC_DIN, 0xF0, 100);
+  merger.feed(SRC_DIN, 0x7E, 200);
+  merger.feed(SRC_USB, 0xC0, 300);
+  merger.feed(SRC_USB, 0x05, 400);
+
+  MidiEvent ev;
+  TEST_ASSERT_TRUE(merger.pop(ev, 500));
+  TEST_ASSERT_TRUE(merger.pop(ev, 500));
+  TEST_ASSERT_EQUAL_HEX8(0x7E, ev.msg.bytes[0]);
+  TEST_ASSERT_FALSE(merger.pop(ev, 200 + MERGER_SYSEX_HOLD_US - 1));
+
+  TEST_ASSERT_TRUE(merger.pop(ev, 200 + MERGER_SYSEX_HOLD_US));
+  TEST_ASSERT_EQUAL(SRC_USB, ev.source);
+  TEST_ASSERT_EQUAL_HEX8(0xC0, ev.msg.bytes[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, merger.sysexTimeouts());
+}
+
+// Host-side throughput of feed() + pop() for two interleaved running-status
+// streams with SysEx chunks, printed next to the MIDI line rate
+void test_throughput()
+{
+  const uint32_t BYTES = 2000000;
+  MidiMerger merger;
+  uint32_t rng = 0xBEEF, timeUs = 0, events = 0;
+  uint8_t phase[SRC_COUNT] = {0, 0};
+  int sysexLeft[SRC_COUNT] = {0, 0};
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BYTES; i++)
+  {
+    MidiSource s = (MidiSource)(xorshift32(rng) & 1);
+    uint8_t b;
+    if (sysexLeft[s] > 0)
+    {
+      b = (--sysexLeft[s] == 0) ? 0xF7 : (i & 0x7F);
+    }
+    else if (phase[s] == 0 && xorshift32(rng) % 64 == 0)
+    {
+      b = 0xF0;
+      sysexLeft[s] = 16;
+    }
+    else
+    {
+      b = (phase[s] == 0) ? (s == SRC_DIN ? 0xB0 : 0x90) : (i & 0x7F);
+      phase[s] = (phase[s] + 1) % 3;
+    }
+    merger.feed(s, b, timeUs++);
+
+    MidiEvent ev;
+    while (merger.pop(ev, timeUs))
+      events++;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  char report[120];
+  snprintf(report, sizeof(report), "Merger: %.1f M bytes/s, %.1f M events/s (%.0fx one 31250-baud port)",
+           BYTES / seconds / 1e6, events / seconds / 1e6, BYTES / seconds / 3125);
+  TEST_MESSAGE(report);
+  TEST_ASSERT_TRUE(events > BYTES / 4);
+  TEST_ASSERT_EQUAL_UINT32(0, merger.dropped(SRC_DIN) + merger.dropped(SRC_USB));
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_sources_do_not_mix);
+  RUN_TEST(test_pop_in_time_order_across_wrap);
+  RUN_TEST(test_full_queue_drops_and_counts);
+  RUN_TEST(test_interleaved_streams_stay_whole);
+  RUN_TEST(test_sysex_holds_other_sources);
+  RUN_TEST(test_sysex_timeout_releases_other_sources);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,131 @@
+#include <unity.h>
+#include "MidiParser.h"
+
+// MidiParser: running status, real-time bytes, system messages, SysEx
+
+// Function to feed bytes and collect the completed messages
+int feedAll(MidiParser &parser, const uint8_t *bytes, int length, MidiMessage *out)
+{
+  int count = 0;
+  for (int i = 0; i < length; i++)
+  {
+    MidiMessage msg;
+    if (parser.feed(bytes[i], msg))
+      out[count++] = msg;
+  }
+  return count;
+}
+
+// Function to check one message
+void assertMessage(const MidiMessage &msg, uint8_t length, uint8_t b0, uint8_t b1, uint8_t b2)
+{
+  TEST_ASSERT_EQUAL_UINT8(length, msg.length);
+  TEST_ASSERT_EQUAL_HEX8(b0, msg.bytes[0]);
+  if (length > 1)
+    TEST_ASSERT_EQUAL_HEX8(b1, msg.bytes[1]);
+  if (length > 2)
+    TEST_ASSERT_EQUAL_HEX8(b2, msg.bytes[2]);
+}
+
+void test_running_status()
+{
+  MidiParser parser;
+  MidiMessage out[4];
+  const uint8_t bytes[] = {0xB0, 0x07, 0x64, 0x08, 0x65, 0xC3, 0x05, 0x06};
+  TEST_ASSERT_EQUAL(4, feedAll(parser, bytes, sizeof(bytes), out));
+  assertMessage(out[0], 3, 0xB0, 0x07, 0x64);
+  assertMessage(out[1], 3, 0xB0, 0x08, 0x65);
+  assertMessage(out[2], 2, 0xC3, 0x05, 0);
+  assertMessage(out[3], 2, 0xC3, 0x06, 0);
+}
+
+void test_real_time_inside_message()
+{
+  MidiParser parser;
+  MidiMessage out[4];
+  const uint8_t bytes[] = {0x90, 0x3C, 0xF8, 0x64, 0xFE};
+  TEST_ASSERT_EQUAL(3, feedAll(parser, bytes, sizeof(bytes), out));
+  assertMessage(out[0], 1, 0xF8, 0, 0);
+  assertMessage(out[1], 3, 0x90, 0x3C, 0x64);
+  assertMessage(out[2], 1, 0xFE, 0, 0);
+}
+
+void test_stray_data_dropped()
+{
+  MidiParser parser;
+  MidiMessage out[4];
+  const uint8_t bytes[] = {0x10, 0x20, 0xB1, 0x01, 0x02};
+  TEST_ASSERT_EQUAL(1, feedAll(parser, bytes, sizeof(bytes), out));
+  assertMessage(out[0], 3, 0xB1, 0x01, 0x02);
+}
+
+void test_system_common_cancels_running_status()
+{
+  MidiParser parser;
+  MidiMessage out[4];
+  const uint8_t bytes[] = {0xB0, 0x07, 0x10, 0xF2, 0x01, 0x02, 0x07, 0x20, 0xF6};
+  TEST_ASSERT_EQUAL(3, feedAll(parser, bytes, sizeof(bytes), out));
+  assertMessage(out[0], 3, 0xB0, 0x07, 0x10);
+  assertMessage(out[1], 3, 0xF2, 0x01, 0x02);
+  assertMessage(out[2], 1, 0xF6, 0, 0);
+}
+
+void test_sysex_bytes_pass_one_by_one()
+{
+  MidiParser parser;
+  MidiMessage out[8];
+  const uint8_t bytes[] = {0xB0, 0x07, 0xF0, 0x7E, 0x01, 0xF7, 0x07, 0x40};
+  TEST_ASSERT_EQUAL(4, feedAll(parser, bytes, sizeof(bytes), out));
+  assertMessage(out[0], 1, 0xF0, 0, 0);
+  assertMessage(out[1], 1, 0x7E, 0, 0);
+  assertMessage(out[2], 1, 0x01, 0, 0);
+  assertMessage(out[3], 1, 0xF7, 0, 0);
+}
+
+void test_reset_drops_partial_message()
+{
+  MidiParser parser;
+  MidiMessage out[4];
+  const uint8_t first[] = {0xB0, 0x07};
+  const uint8_t second[] = {0x40, 0x41};
+  feedAll(parser, first, sizeof(first), out);
+  parser.reset();
+  TEST_ASSERT_EQUAL(0, feedAll(parser, second, sizeof(second), out));
+}
+
+void test_decode()
+{
+  MidiData midi;
+  MidiMessage noteOff = {{0x82, 0x3C, 0x40}, 3};
+  TEST_ASSERT_TRUE(decodeMidiMessage(noteOff, SRC_USB, midi));
+  TEST_ASSERT_EQUAL(MSG_NOTE, midi.type);
+  TEST_ASSERT_EQUAL_UINT8(0x3C, midi.inNumber);
+  TEST_ASSERT_EQUAL_UINT8(0, midi.inValue);
+  TEST_ASSERT_EQUAL(SRC_USB, midi.source);
+
+  MidiMessage cc = {{0xB5, 0x07, 0x64}, 3};
+  TEST_ASSERT_TRUE(decodeMidiMessage(cc, SRC_DIN, midi));
+  TEST_ASSERT_EQUAL(MSG_CC, midi.type);
+  TEST_ASSERT_EQUAL_UINT8(0x64, midi.inValue);
+
+  MidiMessage bend = {{0xE0, 0x00, 0x40}, 3};
+  TEST_ASSERT_FALSE(decodeMidiMessage(bend, SRC_DIN, midi));
+  MidiMessage clock = {{0xF8, 0, 0}, 1};
+  TEST_ASSERT_FALSE(decodeMidiMessage(clock, SRC_DIN, midi));
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_running_status);
+  RUN_TEST(test_real_time_inside_message);
+  RUN_TEST(test_stray_data_dropped);
+  RUN_TEST(test_system_common_cancels_running_status);
+  RUN_TEST(test_sysex_bytes_pass_one_by_one);
+  RUN_TEST(test_reset_drops_partial_message);
+  RUN_TEST(test_decode);
+  return UNITY_END();
+}
@@ -0,0 +1,157 @@
+#include <unity.h>
+#include <memory>
+#include "OutputThinner.h"
+
+// OutputThinner: dedupe, deadband, rate limit, flushes, outside writes
+
+std::unique_ptr<OutputThinner> thinner;
+uint8_t wire[128];  // Last value on the wire per CC (channel 0)
+int flushCount = 0;
+
+// Function to flush due values onto the simulated wire
+void flushAt(uint32_t nowMs)
+{
+  thinner->flush(nowMs, [](uint8_t channel, uint8_t number, uint8_t value)
+                 {
+                   wire[number] = value;
+                   flushCount++;
+                 });
+}
+
+// Function to offer a value and put it on the wire if it is admitted
+bool offer(uint8_t number, uint8_t value, uint8_t deadband, uint8_t minGapMs, uint32_t nowMs)
+{
+  if (!thinner->admit(0, number, value, deadband, minGapMs, nowMs))
+    return false;
+  wire[number] = value;
+  return true;
+}
+
+void test_dedupe_drops_repeats()
+{
+  TEST_ASSERT_TRUE(offer(7, 64, 0, 0, 0));
+  TEST_ASSERT_FALSE(offer(7, 64, 0, 0, 1));
+  TEST_ASSERT_TRUE(offer(7, 65, 0, 0, 2));
+  TEST_ASSERT_EQUAL_UINT32(1, thinner->dropped(OutputThinner::DROP_UNCHANGED));
+  TEST_ASSERT_EQUAL(0, thinner->pendingFlushes());
+}
+
+void test_deadband_value_flushed_after_settle()
+{
+  TEST_ASSERT_TRUE(offer(7, 64, 2, 0, 0));
+  TEST_ASSERT_FALSE(offer(7, 65, 2, 0, 10));
+  TEST_ASSERT_FALSE(offer(7, 66, 2, 0, 20));
+  TEST_ASSERT_EQUAL_UINT8(64, wire[7]);
+
+  flushAt(20 + THIN_SETTLE_MS - 1);
+  TEST_ASSERT_EQUAL_UINT8(64, wire[7]);
+  flushAt(20 + THIN_SETTLE_MS);
+  TEST_ASSERT_EQUAL_UINT8(66, wire[7]);
+  TEST_ASSERT_EQUAL(1, flushCount);
+  TEST_ASSERT_EQUAL_UINT32(2, thinner->dropped(OutputThinner::DROP_DEADBAND));
+}
+
+void test_deadband_passes_range_ends()
+{
+  TEST_ASSERT_TRUE(offer(7, 2, 4, 0, 0));
+  TEST_ASSERT_TRUE(offer(7, 0, 4, 0, 1));
+  TEST_ASSERT_TRUE(offer(8, 125, 4, 0, 0));
+  TEST_ASSERT_TRUE(offer(8, 127, 4, 0, 1));
+}
+
+void test_return_to_sent_value_cancels_flush()
+{
+  TEST_ASSERT_TRUE(offer(7, 64, 2, 0, 0));
+  TEST_ASSERT_FALSE(offer(7, 65, 2, 0, 5));
+  TEST_ASSERT_EQUAL(1, thinner->pendingFlushes());
+  TEST_ASSERT_FALSE(offer(7, 64, 2, 0, 6));
+  TEST_ASSERT_EQUAL(0, thinner->pendingFlushes());
+  flushAt(1000);
+  TEST_ASSERT_EQUAL(0, flushCount);
+}
+
+void test_rate_limit_sends_latest_after_gap()
+{
+  const uint8_t GAP = 20; // max_rate 50
+  TEST_ASSERT_TRUE(offer(7, 10, 0, GAP, 100));
+  TEST_ASSERT_FALSE(offer(7, 20, 0, GAP, 105));
+  TEST_ASSERT_FALSE(offer(7, 30, 0, GAP, 110));
+  flushAt(119);
+  TEST_ASSERT_EQUAL_UINT8(10, wire[7]);
+  flushAt(120);
+  TEST_ASSERT_EQUAL_UINT8(30, wire[7]);
+  TEST_ASSERT_TRUE(offer(7, 40, 0, GAP, 140));
+  TEST_ASSERT_EQUAL_UINT32(2, thinner->dropped(OutputThinner::DROP_RATE));
+}
+
+// An unfiltered write of the same CC must replace a held-back value, or the
+// flush would put an older value back on the wire
+void test_outside_write_replaces_pending()
+{
+  TEST_ASSERT_TRUE(offer(7, 64, 2, 0, 0));
+  TEST_ASSERT_FALSE(offer(7, 65, 2, 0, 5));
+
+  wire[7] = 100;
+  thinner->noteSent(0, 7, 100, 10);
+  TEST_ASSERT_EQUAL(0, thinner->pendingFlushes());
+  flushAt(1000);
+  TEST_ASSERT_EQUAL_UINT8(100, wire[7]);
+
+  // The cache now holds the outside value: a repeat of it is dropped
+  TEST_ASSERT_FALSE(offer(7, 100, 0, 0, 1001));
+  TEST_ASSERT_TRUE(offer(7, 64, 0, 0, 1002));
+}
+
+// A controller idle for a multiple of 65536 ms is not "too recent"
+void test_rate_limit_after_long_idle()
+{
+  const uint8_t GAP = 20;
+  TEST_ASSERT_TRUE(offer(7, 10, 0, GAP, 1000));
+  TEST_ASSERT_TRUE(offer(7, 20, 0, GAP, 1000 + 65536 + 5));
+  TEST_ASSERT_FALSE(offer(7, 30, 0, GAP, 1000 + 65536 + 10));
+  TEST_ASSERT_TRUE(offer(7, 40, 0, GAP, 1000 + 3 * 65536));
+
+  // Across the millis() wrap
+  TEST_ASSERT_TRUE(offer(8, 10, 0, GAP, 0xFFFFFFF8));
+  TEST_ASSERT_FALSE(offer(8, 20, 0, GAP, 0xFFFFFFFC));
+  flushAt(0x0000000B);
+  TEST_ASSERT_EQUAL_UINT8(10, wire[8]);
+  flushAt(0x0000000C);
+  TEST_ASSERT_EQUAL_UINT8(20, wire[8]);
+}
+
+void test_full_pending_list_sends_now()
+{
+  for (uint8_t n = 0; n < THIN_PENDING_MAX + 1; n++)
+    TEST_ASSERT_TRUE(offer(n, 64, 2, 0, 0));
+  for (uint8_t n = 0; n < THIN_PENDING_MAX; n++)
+    TEST_ASSERT_FALSE(offer(n, 65, 2, 0, 1));
+  TEST_ASSERT_TRUE(offer(THIN_PENDING_MAX, 65, 2, 0, 1));
+  TEST_ASSERT_EQUAL(THIN_PENDING_MAX, thinner->pendingFlushes());
+}
+
+void setUp()
+{
+  thinner.reset(new OutputThinner());
+  memset(wire, THIN_NONE, sizeof(wire));
+  flushCount = 0;
+}
+
+void tearDown()
+{
+  thinner.reset();
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_dedupe_drops_repeats);
+  RUN_TEST(test_deadband_value_flushed_after_settle);
+  RUN_TEST(test_deadband_passes_range_ends);
+  RUN_TEST(test_return_to_sent_value_cancels_flush);
+  RUN_TEST(test_rate_limit_sends_latest_after_gap);
+  RUN_TEST(test_outside_write_replaces_pending);
+  RUN_TEST(test_rate_limit_after_long_idle);
+  RUN_TEST(test_full_pending_list_sends_now);
+  return UNITY_END();
+}
@@ -0,0 +1,251 @@
+#include <unity.h>
+#include <vector>
+#include "TimerWheel.h"
+#include "OutputScheduler.h"
+#include "MappingTable.h"
+
+// TimerWheel: due order, long delays, stalls, full pool
+// OutputScheduler: gated notes, retriggers and echoes faster than the gate
+
+struct Fired
+{
+  uint32_t atMs;
+  uint8_t id;
+};
+
+// Function to advance the wheel one millisecond at a time and record what fires
+void runFor(TimerWheel &wheel, uint32_t fromMs, uint32_t ms, std::vector<Fired> &fired)
+{
+  for (uint32_t now = fromMs; now != fromMs + ms + 1; now++)
+    wheel.advance(now, [&](const uint8_t *bytes, uint8_t length, uint8_t tag)
+                  { fired.push_back({now, bytes[1]}); });
+}
+
+// Function to schedule a CC whose number identifies the event
+bool scheduleId(TimerWheel &wheel, uint32_t nowMs, uint32_t delayMs, uint8_t id)
+{
+  const uint8_t bytes[3] = {0xB0, id, 0x40};
+  return wheel.schedule(nowMs, delayMs, bytes, 3);
+}
+
+void test_fires_on_time_in_due_order()
+{
+  TimerWheel wheel;
+  std::vector<Fired> fired;
+  scheduleId(wheel, 1000, 30, 1);
+  scheduleId(wheel, 1000, 10, 2);
+  scheduleId(wheel, 1000, 10, 3);
+  scheduleId(wheel, 1000, 0, 4);
+  runFor(wheel, 1000, 100, fired);
+
+  TEST_ASSERT_EQUAL(4, fired.size());
+  TEST_ASSERT_EQUAL_UINT8(4, fired[0].id);
+  TEST_ASSERT_EQUAL_UINT32(1000, fired[0].atMs);
+  TEST_ASSERT_EQUAL_UINT8(2, fired[1].id);
+  TEST_ASSERT_EQUAL_UINT8(3, fired[2].id);
+  TEST_ASSERT_EQUAL_UINT32(1010, fired[2].atMs);
+  TEST_ASSERT_EQUAL_UINT8(1, fired[3].id);
+  TEST_ASSERT_EQUAL_UINT32(1030, fired[3].atMs);
+  TEST_ASSERT_EQUAL_UINT16(0, wheel.pending());
+}
+
+void test_delay_longer_than_wheel()
+{
+  TimerWheel wheel;
+  std::vector<Fired> fired;
+  scheduleId(wheel, 0, WHEEL_SIZE * 3 + 5, 7);
+  runFor(wheel, 0, WHEEL_SIZE * 4, fired);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(WHEEL_SIZE * 3 + 5, fired[0].atMs);
+}
+
+void test_stall_fires_everything_due()
+{
+  TimerWheel wheel;
+  std::vector<Fired> fired;
+  auto fire = [&](const uint8_t *bytes, uint8_t length, uint8_t tag)
+  { fired.push_back({0, bytes[1]}); };
+
+  // Within one revolution the buckets are visited in due order
+  for (uint8_t i = 0; i < 20; i++)
+    scheduleId(wheel, 500, i * 10, i);
+  wheel.advance(500 + WHEEL_SIZE - 1, fire);
+  TEST_ASSERT_EQUAL(20, fired.size());
+  for (uint8_t i = 0; i < 20; i++)
+    TEST_ASSERT_EQUAL_UINT8(i, fired[i].id);
+
+  // Past a full revolution everything due still fires, just not in due order
+  fired.clear();
+  uint32_t now = 500 + WHEEL_SIZE - 1;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < 20; i++)
+    scheduleId(wheel, now, i * 40, i);
+  wheel.advance(now + 19 * 40 + 1000, fire);
+  TEST_ASSERT_EQUAL(20, fired.size());
+  for (const Fired &f : fired)
+    seen |= 1u << f.id;
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFF, seen);
+  TEST_ASSERT_EQUAL_UINT16(0, wheel.pending());
+}
+
+void test_across_millis_wrap()
+{
+  TimerWheel wheel;
+  std::vector<Fired> fired;
+  uint32_t start = 0xFFFFFFF0;
+  scheduleId(wheel, start, 40, 9);
+  runFor(wheel, start, 100, fired);
+  TEST_ASSERT_EQUAL(1, fired.size());
+  TEST_ASSERT_EQUAL_UINT32(start + 40, fired[0].atMs);
+}
+
+void test_full_pool_drops()
+{
+  TimerWheel wheel;
+  for (uint16_t i = 0; i < WHEEL_CAPACITY; i++)
+    TEST_ASSERT_TRUE(scheduleId(wheel, 0, 100, i & 0x7F));
+  TEST_ASSERT_FALSE(scheduleId(wheel, 0, 100, 0));
+  TEST_ASSERT_EQUAL_UINT32(1, wheel.drops());
+
+  std::vector<Fired> fired;
+  runFor(wheel, 0, 100, fired);
+  TEST_ASSERT_EQUAL(WHEEL_CAPACITY, fired.size());
+  TEST_ASSERT_TRUE(scheduleId(wheel, 100, 1, 0));
+}
+
+// Message on the wire
+struct Sent
+{
+  uint32_t atMs;
+  uint8_t status;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+// Wheel and note tags of a MIDI output, recording what goes on the wire
+struct Output
+{
+  TimerWheel wheel;
+  NoteGenerations gens;
+  std::vector<Sent> sent;
+  uint32_t nowMs = 0;
+
+  void send(const uint8_t *bytes, uint8_t length, uint8_t tag)
+  {
+    gens.sent(bytes, length, tag);
+    sent.push_back({nowMs, bytes[0], bytes[1], length == 3 ? bytes[2] : (uint8_t)0});
+  }
+
+  uint16_t play(const MappedOutput &out)
+  {
+    return scheduleMidiOutput(out, 0, nowMs, wheel, gens, [&](const uint8_t *bytes, uint8_t length, uint8_t tag)
+                              { send(bytes, length, tag); }, [](const uint8_t *bytes, uint8_t length) {});
+  }
+
+  void runUntil(uint32_t endMs)
+  {
+    for (; nowMs <= endMs; nowMs++)
+      fireDueOutputs(wheel, gens, nowMs, [&](const uint8_t *bytes, uint8_t length, uint8_t tag)
+                     { send(bytes, length, tag); });
+    nowMs = endMs;
+  }
+};
+
+// Function to make a gated note output
+MappedOutput gatedNote(uint8_t note, uint16_t gateMs, uint8_t repeat, uint16_t intervalMs)
+{
+  return {MSG_NOTE, note, 100, 0, gateMs, repeat, intervalMs, THIN_OFF, 0};
+}
+
+// A PC mapped to a note plays it and ends it after the gate
+void test_pc_note_gate_sends_on_then_off()
+{
+  static constexpr MapRule RULES[] = {mapRule(MSG_PC, 5, MSG_NOTE, 60, 1.0f, 250)};
+  static constexpr auto MAPPING = buildMapping(RULES);
+  Output output;
+  output.nowMs = 1000;
+
+  MidiData pc = {MSG_PC, 5, 0, 0, 0, SRC_DIN};
+  mapMessage(MAPPING.table(), pc, nullptr, [&](const MappedOutput &out)
+             { output.play(out); });
+  output.runUntil(2000);
+
+  TEST_ASSERT_EQUAL(2, output.sent.size());
+  TEST_ASSERT_EQUAL_UINT8(0x90, output.sent[0].status);
+  TEST_ASSERT_EQUAL_UINT8(60, output.sent[0].note);
+  TEST_ASSERT_EQUAL_UINT8(PC_NOTE_VELOCITY, output.sent[0].velocity);
+  TEST_ASSERT_EQUAL_UINT32(1000, output.sent[0].atMs);
+  TEST_ASSERT_EQUAL_UINT8(60, output.sent[1].note);
+  TEST_ASSERT_EQUAL_UINT8(0, output.sent[1].velocity);
+  TEST_ASSERT_EQUAL_UINT32(1250, output.sent[1].atMs);
+}
+
+// A retrigger inside the gate is not cut short by the first note's off
+void test_retrigger_keeps_new_note()
+{
+  Output output;
+  output.play(gatedNote(64, 250, 0, 0));
+  output.runUntil(100);
+  output.play(gatedNote(64, 250, 0, 0));
+
+  // A note on from elsewhere (pass-through) also ends the gates before it
+  output.runUntil(200);
+  const uint8_t noteOn[3] = {0x90, 64, 90};
+  output.send(noteOn, 3, 0);
+  output.runUntil(1000);
+
+  TEST_ASSERT_EQUAL(3, output.sent.size());
+  TEST_ASSERT_EQUAL_UINT8(90, output.sent[2].velocity);
+  output.sent.clear();
+
+  // Without a newer note on the gate ends the note
+  output.play(gatedNote(64, 250, 0, 0));
+  output.runUntil(2000);
+  TEST_ASSERT_EQUAL(2, output.sent.size());
+  TEST_ASSERT_EQUAL_UINT8(0, output.sent[1].velocity);
+  TEST_ASSERT_EQUAL_UINT32(1250, output.sent[1].atMs);
+}
+
+// Echoes closer together than the gate send one note off, after the last
+void test_fast_echo_ends_once()
+{
+  Output output;
+  output.play(gatedNote(67, 250, 2, 100));
+  output.runUntil(1000);
+
+  TEST_ASSERT_EQUAL(4, output.sent.size());
+  for (int i = 0; i < 3; i++)
+  {
+    TEST_ASSERT_EQUAL_UINT8(100, output.sent[i].velocity);
+    TEST_ASSERT_EQUAL_UINT32(i * 100, output.sent[i].atMs);
+  }
+  TEST_ASSERT_EQUAL_UINT8(0, output.sent[3].velocity);
+  TEST_ASSERT_EQUAL_UINT32(450, output.sent[3].atMs);
+  TEST_ASSERT_EQUAL_UINT16(0, output.wheel.pending());
+
+  // Echoes as far apart as the gate end each copy before the next
+  output.sent.clear();
+  output.play(gatedNote(67, 100, 1, 100));
+  output.runUntil(2000);
+  TEST_ASSERT_EQUAL(4, output.sent.size());
+  TEST_ASSERT_EQUAL_UINT8(0, output.sent[1].velocity);
+  TEST_ASSERT_EQUAL_UINT8(100, output.sent[2].velocity);
+  TEST_ASSERT_EQUAL_UINT32(1200, output.sent[3].atMs);
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fires_on_time_in_due_order);
+  RUN_TEST(test_delay_longer_than_wheel);
+  RUN_TEST(test_stall_fires_everything_due);
+  RUN_TEST(test_across_millis_wrap);
+  RUN_TEST(test_full_pool_drops);
+  RUN_TEST(test_pc_note_gate_sends_on_then_off);
+  RUN_TEST(test_retrigger_keeps_new_note);
+  RUN_TEST(test_fast_echo_ends_once);
+  return UNITY_END();
+}